@@ -8,31 +8,153 @@
 #define BoxFlag				0xCB3
 #define Ticks				0x16A
 #define AddrMapFlags		0xDD0
+#define VIA1Base			0x1D4
+
+#include "trace.h"
 
 typedef void (*VIA2Handler)(void);
 
+#ifdef ASCTESTER_HOST
+
+// Host build: every hardware access the tests make goes through this interface,
+// which is implemented by the simulated machine in host/.
+
+uint8_t ascReadReg(uint16_t offset);
+void ascWriteReg(uint16_t offset, uint8_t value);
+void ascWriteWord(uint16_t offset, uint16_t value);
+void ascWriteLong(uint16_t offset, uint32_t value);
+uint8_t via2ReadReg(uint16_t offset);
+void via2WriteReg(uint16_t offset, uint8_t value);
+uint32_t via2ReadLong(uint16_t offset);
+uint8_t via1ReadReg(uint16_t offset);
+volatile VIA2Handler *via2Handlers(void);
+uint32_t ticks(void);
+uint32_t currentTicks(void);
+bool ticksElapsed(uint32_t startTicks, uint32_t count);
+void waitTicks(uint32_t count);
+uint32_t addrMapFlags(void);
+uint8_t boxFlag(void);
+void **applScratch(void);
+uint16_t DisableIRQ(void);
+void RestoreIRQ(uint16_t sr);
+void nop(void);
+
+#else
+
+// Disables interrupts and returns the old SR so they can be restored to what they were
+static inline uint16_t DisableIRQ(void)
+{
+	uint16_t sr;
+
+	__asm__ volatile (
+		"move.w %%sr,%0\n\t"     /* read current SR */
+		"ori.w  #0x0700,%%sr"    /* set IPL = 7 (disable interrupts) */
+		: "=d"(sr)
+		:
+		: "cc"
+	);
+
+	return sr;
+}
+
+// Restores the IRQ state to what it was before
+static inline void RestoreIRQ(uint16_t sr)
+{
+	__asm__ volatile (
+		"move.w %0,%%sr"
+		:
+		: "d"(sr)
+		: "cc"
+	);
+}
+
+#ifdef ASCTESTER_TRACE
+// Records a register access in the trace (if one is active). Interrupts are held off
+// while the event is stored so an IRQ handler can't claim the same slot; the IPL we
+// find tells us whether we're in a handler (1-6) or not (0, or 7 inside DisableIRQ).
+static inline void traceAccess(uint16_t offset, uint8_t value, uint8_t flags)
+{
+	TraceBuffer *t = traceBuffer;
+	if (t)
+	{
+		const uint16_t sr = DisableIRQ();
+		const uint8_t ipl = (sr >> 8) & 7;
+		TraceStore(t, *(volatile uint32_t *)Ticks, offset, value,
+				(ipl != 0 && ipl != 7) ? (flags | TraceIRQ) : flags);
+		RestoreIRQ(sr);
+	}
+}
+#else
+static inline void traceAccess(uint16_t offset, uint8_t value, uint8_t flags)
+{
+}
+#endif
+
 // Reads an ASC register
 static inline uint8_t ascReadReg(uint16_t offset)
 {
-	return *((*(volatile uint8_t **)ASCBase) + offset);
+	const uint8_t value = *((*(volatile uint8_t **)ASCBase) + offset);
+	traceAccess(offset, value, 0);
+	return value;
 }
 
 // Writes an ASC register
 static inline void ascWriteReg(uint16_t offset, uint8_t value)
 {
 	*((*(volatile uint8_t **)ASCBase) + offset) = value;
+	traceAccess(offset, value, TraceWrite);
+}
+
+// Writes a word to the ASC's address space. The trace sees it as two byte writes,
+// which is what the bus does if the ASC only takes a byte at a time.
+static inline void ascWriteWord(uint16_t offset, uint16_t value)
+{
+	*(volatile uint16_t *)((*(volatile uint8_t **)ASCBase) + offset) = value;
+	traceAccess(offset, (uint8_t)(value >> 8), TraceWrite);
+	traceAccess(offset + 1, (uint8_t)value, TraceWrite);
+}
+
+// Writes a long word to the ASC's address space, seen by the trace as four byte writes
+static inline void ascWriteLong(uint16_t offset, uint32_t value)
+{
+	*(volatile uint32_t *)((*(volatile uint8_t **)ASCBase) + offset) = value;
+	for (int i = 0; i < 4; i++)
+	{
+		traceAccess(offset + i, (uint8_t)(value >> (24 - i * 8)), TraceWrite);
+	}
 }
 
 // Reads a VIA2 register
 static inline uint8_t via2ReadReg(uint16_t offset)
 {
-	return *((*(volatile uint8_t **)VIA2Base) + offset);
+	const uint8_t value = *((*(volatile uint8_t **)VIA2Base) + offset);
+	traceAccess(offset, value, TraceVIA2);
+	return value;
 }
 
 // Writes a VIA2 register
 static inline void via2WriteReg(uint16_t offset, uint8_t value)
 {
 	*((*(volatile uint8_t **)VIA2Base) + offset) = value;
+	traceAccess(offset, value, TraceVIA2 | TraceWrite);
+}
+
+// Reads a long word from VIA2's address space. The trace sees it as four byte reads,
+// which is what the bus does with an 8-bit VIA.
+static inline uint32_t via2ReadLong(uint16_t offset)
+{
+	const uint32_t value = *(uint32_t *)((*(uint8_t **)VIA2Base) + offset);
+	for (int i = 0; i < 4; i++)
+	{
+		traceAccess(offset + i, (uint8_t)(value >> (24 - i * 8)), TraceVIA2);
+	}
+	return value;
+}
+
+// Reads a VIA1 register. Only the timing code uses this, so it isn't traced.
+static inline uint8_t via1ReadReg(uint16_t offset)
+{
+	return *((*(volatile uint8_t **)VIA1Base) + offset);
 }
 
 // The VIA2 dispatch table
@@ -47,36 +169,52 @@ static inline uint32_t ticks(void)
 	return *(volatile uint32_t *)Ticks;
 }
 
+// Reads the tick count for a timestamp. Unlike ticks(), it isn't taken as a poll of
+// a wait loop, so a simulated backend won't skip ahead because of it.
+static inline uint32_t currentTicks(void)
+{
+	return *(volatile uint32_t *)Ticks;
+}
+
+// Whether the given number of ticks have elapsed since startTicks. Polling loops
+// use this so a simulated backend can skip ahead to the next thing that happens.
+static inline bool ticksElapsed(uint32_t startTicks, uint32_t count)
+{
+	return ticks() - startTicks >= count;
+}
+
+// Waits for the given number of ticks
+static inline void waitTicks(uint32_t count)
+{
+	const uint32_t startTicks = ticks();
+	while (!ticksElapsed(startTicks, count))
+	{
+	}
+}
+
 static inline uint32_t addrMapFlags(void)
 {
 	return *(uint32_t *)AddrMapFlags;
 }
 
-// Disables interrupts and returns the old SR so they can be restored to what they were
-static inline uint16_t DisableIRQ(void)
+// Machine identifier byte
+static inline uint8_t boxFlag(void)
 {
-	uint16_t sr;
-
-	__asm__ volatile (
-		"move.w %%sr,%0\n\t"     /* read current SR */
-		"ori.w  #0x0700,%%sr"    /* set IPL = 7 (disable interrupts) */
-		: "=d"(sr)
-		:
-		: "cc"
-	);
+	return *(uint8_t *)BoxFlag;
+}
 
-	return sr;
+// Low-memory scratch space used to hand a pointer to IRQ handlers
+static inline void **applScratch(void)
+{
+	return (void **)ApplScratch;
 }
 
-// Restores the IRQ state to what it was before
-static inline void RestoreIRQ(uint16_t sr)
+// Burns a single CPU instruction
+static inline void nop(void)
 {
-	__asm__ volatile (
-		"move.w %0,%%sr"
-		:
-		: "d"(sr)
-		: "cc"
-	);
+	__asm__ volatile ( "nop;" );
 }
 
 #endif
+
+#endif
@@ -0,0 +1,581 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Grades ASCTester reports against the known-good results in golden.txt. Any number of
+// files can be checked at once, and each one can hold any number of reports (such as
+// the output of asctester-host, or text saved from runs on real machines).
+
+// Largest count that still counts as "well below" the 50000 IRQ flood limit
+#define NONFLOOD_MAX				25000
+
+// How a number in the expected output is matched
+enum RuleType
+{
+	RuleExact,								// Must be the same number
+	RuleAny,								// Anything goes
+	RuleRange,								// From min to max
+	RuleNonFlood,							// Greater than 0 and well below 50000
+	RuleOneOf								// Any of a list of numbers
+};
+
+// A number as printed: decimal, or hex with a $ in front
+struct Number
+{
+	bool hex;
+	uint32_t value;
+};
+
+// Piece of a line. Lines are split into numbers and the text between them.
+struct Token
+{
+	bool isNumber;
+	std::string text;						// Text as written, with runs of spaces collapsed
+	Number number;							// (Only if isNumber) the number
+	RuleType rule;							// (Only if isNumber) how to match it
+	uint32_t min;							// (Only for RuleRange) smallest allowed value
+	uint32_t max;							// (Only for RuleRange) largest allowed value
+	std::vector<Number> choices;			// (Only for RuleOneOf) allowed values
+};
+
+typedef std::vector<Token> Line;
+
+// Known-good result for one machine
+struct Golden
+{
+	std::string name;						// Machine name
+	int testVersion;						// Test version the result came from
+	int boxFlag;							// Machine identifier byte
+	int ascVersion;							// ASC revision byte
+	std::vector<Line> lines;				// Expected output
+};
+
+// A report found in one of the files being checked
+struct Report
+{
+	std::string where;						// File and line the report starts at
+	int testVersion;						// Version line at the top (1 if it doesn't have one)
+	std::vector<std::string> text;			// Lines of the report
+	std::vector<Line> lines;				// The same lines, split into tokens
+};
+
+static std::vector<Golden> goldens;
+static bool verbose;
+
+// Parses a number at *p, advancing past it. Returns false if there isn't one.
+static bool ParseNumber(const char **p, Number *n)
+{
+	const char *s = *p;
+	char *end;
+	if (s[0] == '$' && isxdigit((unsigned char)s[1]))
+	{
+		n->hex = true;
+		n->value = strtoul(s + 1, &end, 16);
+	}
+	else if (isdigit((unsigned char)s[0]))
+	{
+		n->hex = false;
+		n->value = strtoul(s, &end, 10);
+	}
+	else
+	{
+		return false;
+	}
+	*p = end;
+	return true;
+}
+
+// Parses a {rule} at *p (just past the brace) into t. Returns false if it's malformed.
+static bool ParseRule(const char **p, Token *t)
+{
+	const char *s = *p;
+	const char *close = strchr(s, '}');
+	if (!close)
+	{
+		return false;
+	}
+	const std::string body(s, close - s);
+	*p = close + 1;
+
+	t->isNumber = true;
+	t->text = "{" + body + "}";
+	if (body == "*")
+	{
+		t->rule = RuleAny;
+		return true;
+	}
+	if (body == "nonflood")
+	{
+		t->rule = RuleNonFlood;
+		return true;
+	}
+
+	const char *b = body.c_str();
+	Number first;
+	if (!ParseNumber(&b, &first))
+	{
+		return false;
+	}
+	if (!strncmp(b, "..", 2))
+	{
+		Number last;
+		b += 2;
+		if (!ParseNumber(&b, &last) || *b)
+		{
+			return false;
+		}
+		t->rule = RuleRange;
+		t->number = first;
+		t->min = first.value;
+		t->max = last.value;
+		return true;
+	}
+
+	t->rule = RuleOneOf;
+	t->choices.push_back(first);
+	while (*b == '|')
+	{
+		Number next;
+		b++;
+		if (!ParseNumber(&b, &next))
+		{
+			return false;
+		}
+		t->choices.push_back(next);
+	}
+	return *b == 0;
+}
+
+// Splits a line into tokens. Rules are only allowed in golden lines.
+static bool Tokenize(const char *s, bool allowRules, Line *line)
+{
+	std::string text;
+	line->clear();
+
+	while (*s)
+	{
+		Token t = Token();
+		const char *start = s;
+		if (ParseNumber(&s, &t.number))
+		{
+			t.isNumber = true;
+			t.rule = RuleExact;
+			t.text.assign(start, s - start);
+		}
+		else if (allowRules && *s == '{')
+		{
+			s++;
+			if (!ParseRule(&s, &t))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			// Text up to the next number, with runs of whitespace collapsed
+			if (isspace((unsigned char)*s))
+			{
+				while (isspace((unsigned char)*s))
+				{
+					s++;
+				}
+				text += ' ';
+			}
+			else
+			{
+				text += *s++;
+			}
+			continue;
+		}
+
+		if (!text.empty())
+		{
+			Token literal = Token();
+			literal.text = text;
+			line->push_back(literal);
+			text.clear();
+		}
+		line->push_back(t);
+	}
+
+	// Trailing whitespace doesn't matter
+	while (!text.empty() && text[text.size() - 1] == ' ')
+	{
+		text.erase(text.size() - 1);
+	}
+	if (!text.empty())
+	{
+		Token literal = Token();
+		literal.text = text;
+		line->push_back(literal);
+	}
+	return true;
+}
+
+// Reads a whole line from f, without the line ending. Returns false at the end of the file.
+static bool ReadLine(FILE *f, std::string *line)
+{
+	int c;
+	line->clear();
+	while ((c = fgetc(f)) != EOF && c != '\n')
+	{
+		if (c != '\r')
+		{
+			*line += (char)c;
+		}
+	}
+	return c != EOF || !line->empty();
+}
+
+static bool StartsWith(const std::string &s, const char *prefix)
+{
+	return !s.compare(0, strlen(prefix), prefix);
+}
+
+// Finds the BoxFlag and ASC version in a report's "BoxFlag:" line
+static bool IdentifyMachine(const std::vector<Line> &lines, int *boxFlag, int *ascVersion)
+{
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		const Line &l = lines[i];
+		if (l.size() >= 4 && !l[0].isNumber && l[0].text == "BoxFlag: " && l[1].isNumber &&
+			!l[2].isNumber && l[2].text == " ASC Version: " && l[3].isNumber)
+		{
+			*boxFlag = l[1].number.value;
+			*ascVersion = l[3].number.value;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Loads the golden results
+static bool LoadGoldens(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		perror(path);
+		return false;
+	}
+
+	std::string text;
+	Golden *g = NULL;
+	int lineNumber = 0;
+	while (ReadLine(f, &text))
+	{
+		lineNumber++;
+		if (!g)
+		{
+			if (StartsWith(text, "machine "))
+			{
+				goldens.push_back(Golden());
+				g = &goldens.back();
+				g->name = text.substr(8);
+				g->testVersion = 1;
+			}
+			else if (!text.empty() && text[0] != '#')
+			{
+				fprintf(stderr, "%s:%d: expected a machine line\n", path, lineNumber);
+				fclose(f);
+				return false;
+			}
+			continue;
+		}
+
+		if (text == "end")
+		{
+			if (!IdentifyMachine(g->lines, &g->boxFlag, &g->ascVersion))
+			{
+				fprintf(stderr, "%s:%d: %s has no BoxFlag line\n", path, lineNumber, g->name.c_str());
+				fclose(f);
+				return false;
+			}
+			g = NULL;
+			continue;
+		}
+
+		Line line;
+		if (!Tokenize(text.c_str(), true, &line))
+		{
+			fprintf(stderr, "%s:%d: bad rule\n", path, lineNumber);
+			fclose(f);
+			return false;
+		}
+		if (StartsWith(text, "ASCTester test version "))
+		{
+			g->testVersion = atoi(text.c_str() + 23);
+		}
+		g->lines.push_back(line);
+	}
+
+	fclose(f);
+	if (g)
+	{
+		fprintf(stderr, "%s: %s is missing its end line\n", path, g->name.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Collects the reports in a file. A report starts at a version line (or a BoxFlag line,
+// for the oldest versions) and runs until a blank line, a host run's "===" header, or
+// the end of a Markdown code block.
+static bool LoadReports(const char *path, std::vector<Report> *reports)
+{
+	FILE *f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	if (!f)
+	{
+		perror(path);
+		return false;
+	}
+
+	std::string text;
+	Report *r = NULL;
+	int lineNumber = 0;
+	while (ReadLine(f, &text))
+	{
+		lineNumber++;
+		const bool versionLine = StartsWith(text, "ASCTester test version ");
+		if (versionLine || (!r && StartsWith(text, "BoxFlag: ")))
+		{
+			char where[256];
+			snprintf(where, sizeof(where), "%s:%d", path, lineNumber);
+			reports->push_back(Report());
+			r = &reports->back();
+			r->where = where;
+			r->testVersion = versionLine ? atoi(text.c_str() + 23) : 1;
+		}
+		else if (!r)
+		{
+			continue;
+		}
+		else if (text.find_first_not_of(" \t") == std::string::npos || StartsWith(text, "===") ||
+			StartsWith(text, "```"))
+		{
+			r = NULL;
+			continue;
+		}
+
+		Line line;
+		Tokenize(text.c_str(), false, &line);
+		r->text.push_back(text);
+		r->lines.push_back(line);
+	}
+
+	if (f != stdin)
+	{
+		fclose(f);
+	}
+	return true;
+}
+
+// Describes what a golden number allows
+static std::string Expected(const Token &t)
+{
+	char s[64];
+	switch (t.rule)
+	{
+	case RuleExact:
+		return t.text;
+	case RuleAny:
+		return "anything";
+	case RuleRange:
+		snprintf(s, sizeof(s), "%u..%u", t.min, t.max);
+		return s;
+	case RuleNonFlood:
+		snprintf(s, sizeof(s), "1..%u", NONFLOOD_MAX);
+		return s;
+	case RuleOneOf:
+		return "one of " + t.text;
+	}
+	return t.text;
+}
+
+// Whether a number from a report satisfies a golden number's rule
+static bool NumberMatches(const Token &golden, const Number &n)
+{
+	switch (golden.rule)
+	{
+	case RuleExact:
+		return n.hex == golden.number.hex && n.value == golden.number.value;
+	case RuleAny:
+		return true;
+	case RuleRange:
+		return n.value >= golden.min && n.value <= golden.max;
+	case RuleNonFlood:
+		return n.value > 0 && n.value <= NONFLOOD_MAX;
+	case RuleOneOf:
+		for (size_t i = 0; i < golden.choices.size(); i++)
+		{
+			if (n.hex == golden.choices[i].hex && n.value == golden.choices[i].value)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+	return false;
+}
+
+// Adds a description of something that didn't match
+static void Problem(std::vector<std::string> *problems, const char *format, ...)
+{
+	char s[512];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(s, sizeof(s), format, args);
+	va_end(args);
+	problems->push_back(s);
+}
+
+// Compares one report line against its golden line, noting anything that's wrong
+static void CompareLine(const Line &golden, const Line &actual, size_t lineIndex, const std::string &text,
+		std::vector<std::string> *problems)
+{
+	bool sameShape = golden.size() == actual.size();
+	for (size_t i = 0; sameShape && i < golden.size(); i++)
+	{
+		if (golden[i].isNumber != actual[i].isNumber ||
+			(!golden[i].isNumber && golden[i].text != actual[i].text))
+		{
+			sameShape = false;
+		}
+	}
+	if (!sameShape)
+	{
+		Problem(problems, "line %u: unexpected format: %s", (unsigned)lineIndex + 1, text.c_str());
+		return;
+	}
+
+	int field = 0;
+	for (size_t i = 0; i < golden.size(); i++)
+	{
+		if (!golden[i].isNumber)
+		{
+			continue;
+		}
+		field++;
+		if (!NumberMatches(golden[i], actual[i].number))
+		{
+			Problem(problems, "line %u field %d: got %s, expected %s", (unsigned)lineIndex + 1, field,
+					actual[i].text.c_str(), Expected(golden[i]).c_str());
+		}
+	}
+}
+
+// How a report was graded
+enum Grade
+{
+	GradePass,
+	GradeFail,
+	GradeUnknown
+};
+
+// Grades one report against the golden result for the same machine and test version
+static Grade GradeReport(const Report &r)
+{
+	int boxFlag, ascVersion;
+	if (!IdentifyMachine(r.lines, &boxFlag, &ascVersion))
+	{
+		printf("SKIP %s: no BoxFlag/ASC version line\n", r.where.c_str());
+		return GradeUnknown;
+	}
+
+	const Golden *g = NULL;
+	for (size_t i = 0; i < goldens.size() && !g; i++)
+	{
+		if (goldens[i].boxFlag == boxFlag && goldens[i].ascVersion == ascVersion &&
+			goldens[i].testVersion == r.testVersion)
+		{
+			g = &goldens[i];
+		}
+	}
+	if (!g)
+	{
+		if (verbose)
+		{
+			printf("SKIP %s: no version %d result for BoxFlag %d ASC $%02X\n", r.where.c_str(),
+					r.testVersion, boxFlag, ascVersion);
+		}
+		return GradeUnknown;
+	}
+
+	std::vector<std::string> problems;
+	const size_t common = (r.lines.size() < g->lines.size()) ? r.lines.size() : g->lines.size();
+	for (size_t i = 0; i < common; i++)
+	{
+		CompareLine(g->lines[i], r.lines[i], i, r.text[i], &problems);
+	}
+	for (size_t i = common; i < g->lines.size(); i++)
+	{
+		Problem(&problems, "line %u: missing", (unsigned)i + 1);
+	}
+	for (size_t i = common; i < r.lines.size(); i++)
+	{
+		Problem(&problems, "line %u: unexpected: %s", (unsigned)i + 1, r.text[i].c_str());
+	}
+
+	printf("%s %s: %s (version %d)\n", problems.empty() ? "PASS" : "FAIL", r.where.c_str(),
+			g->name.c_str(), r.testVersion);
+	for (size_t i = 0; i < problems.size(); i++)
+	{
+		printf("    %s\n", problems[i].c_str());
+	}
+	return problems.empty() ? GradePass : GradeFail;
+}
+
+static void Usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-v] golden.txt [report ...]\n", argv0);
+	fprintf(stderr, "Checks every report in the given files (- or none for stdin) against golden.txt.\n");
+	fprintf(stderr, "-v also lists reports that have no golden result to compare against.\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int arg = 1;
+	if (arg < argc && !strcmp(argv[arg], "-v"))
+	{
+		verbose = true;
+		arg++;
+	}
+	if (arg >= argc)
+	{
+		Usage(argv[0]);
+		return 2;
+	}
+	if (!LoadGoldens(argv[arg++]))
+	{
+		return 2;
+	}
+
+	std::vector<Report> reports;
+	if (arg == argc)
+	{
+		LoadReports("-", &reports);
+	}
+	for (; arg < argc; arg++)
+	{
+		if (!LoadReports(argv[arg], &reports))
+		{
+			return 2;
+		}
+	}
+
+	int counts[3] = {0, 0, 0};
+	for (size_t i = 0; i < reports.size(); i++)
+	{
+		counts[GradeReport(reports[i])]++;
+	}
+
+	printf("%u reports: %d passed, %d failed, %d without a golden result\n", (unsigned)reports.size(),
+			counts[GradePass], counts[GradeFail], counts[GradeUnknown]);
+	return counts[GradeFail] ? 1 : 0;
+}
@@ -0,0 +1,606 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "sim.h"
+#include "sequence.h"
+
+// Plays random register sequences on two simulated machines and looks for a place
+// where they disagree. The first sequence that does is shrunk to the fewest and
+// smallest operations that still disagree, and saved as a sequence file ASCTester
+// can play on a real Mac.
+
+// Registers the generated sequences read
+static const uint16_t ascReadRegs[] = { 0x801, 0x802, 0x804, 0xF09, 0xF29 };
+static const uint16_t via2ReadRegs[] = { 0x1A03, 0x1C13 };
+
+// Fill sizes around the FIFO's half and full levels
+static const uint16_t fillSizes[] = { 0x1FF, 0x200, 0x201, 0x3FF, 0x400, 0x401 };
+
+// What to compare, and on which machines
+struct Fuzz
+{
+	const SimProfile *profiles[2];
+	uint32_t length;						// Operations per sequence
+	uint64_t seed;
+	std::vector<uint16_t> ignoredASC;		// ASC registers whose reads aren't compared
+	std::vector<uint16_t> ignoredVIA2;		// VIA2 registers whose reads aren't compared
+	bool ignoreIRQCounts;					// Don't compare how many IRQs each wait saw
+};
+
+static Fuzz fuzz;
+static std::atomic<uint64_t> nextSequence;
+static std::atomic<uint64_t> firstFound;
+static std::atomic<uint64_t> accesses;
+static uint64_t sequenceCount;
+
+// xorshift64*. Every sequence gets its own generator seeded from its number, so the
+// sequences don't depend on how they're spread over threads.
+static uint32_t Random(uint64_t *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return (uint32_t)((*state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static uint32_t RandomBelow(uint64_t *state, uint32_t n)
+{
+	return Random(state) % n;
+}
+
+static void GenerateOp(uint64_t *rng, SeqOp *op)
+{
+	op->address = 0;
+	op->value = 0;
+
+	switch (RandomBelow(rng, 14))
+	{
+	case 0:
+		op->type = SeqASCWrite;
+		op->address = 0x801;
+		op->value = RandomBelow(rng, 3);
+		break;
+	case 1:
+		op->type = SeqASCWrite;
+		op->address = 0x802;
+		op->value = RandomBelow(rng, 2) ? 0x02 : 0x00;
+		break;
+	case 2:
+		op->type = SeqASCWrite;
+		op->address = 0x803;
+		op->value = RandomBelow(rng, 2) ? 0x80 : 0x00;
+		break;
+	case 3:
+		op->type = SeqASCWrite;
+		op->address = RandomBelow(rng, 2) ? 0xF29 : 0xF09;
+		op->value = RandomBelow(rng, 2);
+		break;
+	case 4:
+		op->type = SeqVIA2Write;
+		op->address = 0x1C13;
+		op->value = RandomBelow(rng, 2) ? 0x90 : 0x10;
+		break;
+	case 5:
+		op->type = SeqVIA2Write;
+		op->address = 0x1A03;
+		op->value = 0x90;
+		break;
+	case 6:
+	case 7:
+	case 8:
+		op->type = SeqASCRead;
+		op->address = ascReadRegs[RandomBelow(rng, sizeof(ascReadRegs)/sizeof(ascReadRegs[0]))];
+		break;
+	case 9:
+		op->type = SeqVIA2Read;
+		op->address = via2ReadRegs[RandomBelow(rng, sizeof(via2ReadRegs)/sizeof(via2ReadRegs[0]))];
+		break;
+	case 10:
+	case 11:
+		op->type = SeqFill;
+		op->address = RandomBelow(rng, 2) ? 0x400 : 0x000;
+		op->value = RandomBelow(rng, 4) ? fillSizes[RandomBelow(rng, sizeof(fillSizes)/sizeof(fillSizes[0]))] :
+			1 + RandomBelow(rng, 0x100);
+		break;
+	default:
+		op->type = SeqWait;
+		op->value = 1 + RandomBelow(rng, 3);
+		break;
+	}
+}
+
+static void GenerateSequence(uint64_t number, std::vector<SeqOp> *ops)
+{
+	uint64_t rng = (fuzz.seed ^ (number * 0x9E3779B97F4A7C15ULL)) | 1;
+	ops->resize(fuzz.length);
+	for (uint32_t i = 0; i < fuzz.length; i++)
+	{
+		GenerateOp(&rng, &(*ops)[i]);
+	}
+}
+
+// Register accesses an operation makes, not counting IRQ handlers
+static uint32_t CountAccesses(const SeqOp *op)
+{
+	return (op->type == SeqFill) ? op->value : (op->type == SeqWait) ? 0 : 1;
+}
+
+static bool Contains(const std::vector<uint16_t> &list, uint16_t value)
+{
+	for (size_t i = 0; i < list.size(); i++)
+	{
+		if (list[i] == value)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Both machines, with a sequence playing on each
+struct FuzzMachines
+{
+	SimMachine m[2];
+	SeqPlayer players[2];
+};
+
+// Both machines' state at some point in a sequence, to branch from
+struct FuzzBranch
+{
+	SimSnapshot machines[2];
+	SeqPlayer players[2];
+};
+
+// Starts both machines from power-on, ready to play a sequence
+static void Prime(FuzzMachines *fm)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		SimInit(&fm->m[i], fuzz.profiles[i]);
+		SimSetCurrent(&fm->m[i]);
+		SeqBegin(&fm->players[i]);
+	}
+}
+
+static void SaveBranch(const FuzzMachines *fm, FuzzBranch *b)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		SimSave(&fm->m[i], &b->machines[i]);
+		b->players[i] = fm->players[i];
+	}
+}
+
+// Puts both machines back to a saved point. The players are restored in place, since
+// the machines' ApplScratch points at them.
+static void RestoreBranch(FuzzMachines *fm, const FuzzBranch *b)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		SimRestore(&fm->m[i], &b->machines[i]);
+		fm->players[i] = b->players[i];
+	}
+}
+
+// Bits of an observation that both machines model and that we were asked to compare
+static uint16_t ComparedBits(const FuzzMachines *fm, const SeqOp *op)
+{
+	switch (op->type)
+	{
+	case SeqASCRead:
+		return Contains(fuzz.ignoredASC, op->address) ? 0 :
+			(SimASCModeledBits(&fm->m[0], op->address) & SimASCModeledBits(&fm->m[1], op->address));
+	case SeqVIA2Read:
+		return Contains(fuzz.ignoredVIA2, op->address) ? 0 :
+			(SimVIA2ModeledBits(&fm->m[0], op->address) & SimVIA2ModeledBits(&fm->m[1], op->address));
+	case SeqWait:
+		return fuzz.ignoreIRQCounts ? 0 : 0xFFFF;
+	default:
+		return 0;
+	}
+}
+
+// Plays a sequence on both machines from operation first on, from wherever they are
+// now, and stops at the first observation they disagree on. Returns its index, or the
+// sequence's length if they agree. If branches isn't NULL, the state before each
+// operation played is saved in it. If observed isn't NULL, it gets what each machine
+// observed.
+static size_t PlayFrom(FuzzMachines *fm, const std::vector<SeqOp> &ops, size_t first,
+		std::vector<FuzzBranch> *branches, std::vector<uint16_t> *observed)
+{
+	uint64_t played = 0;
+	size_t i;
+
+	if (branches)
+	{
+		branches->resize(ops.size());
+	}
+	if (observed)
+	{
+		observed[0].resize(ops.size());
+		observed[1].resize(ops.size());
+	}
+	for (i = first; i < ops.size(); i++)
+	{
+		if (branches)
+		{
+			SaveBranch(fm, &(*branches)[i]);
+		}
+
+		uint16_t value[2];
+		for (int j = 0; j < 2; j++)
+		{
+			SimSetCurrent(&fm->m[j]);
+			value[j] = SeqStep(&fm->players[j], &ops[i]);
+			if (observed)
+			{
+				observed[j][i] = value[j];
+			}
+		}
+		played += 2 * CountAccesses(&ops[i]);
+
+		if ((value[0] ^ value[1]) & ComparedBits(fm, &ops[i]))
+		{
+			break;
+		}
+	}
+
+	accesses += played;
+	return i;
+}
+
+// Keeps playing sequences until one disagrees. Every sequence branches from the same
+// primed state. Sequences after the first one found don't need to be played, but
+// earlier ones still do, so the result is the same no matter how many threads there
+// are.
+static void Worker(void)
+{
+	static thread_local FuzzMachines fm;
+	static thread_local FuzzBranch primed;
+	std::vector<SeqOp> ops;
+	uint64_t n;
+
+	Prime(&fm);
+	SaveBranch(&fm, &primed);
+	while ((n = nextSequence++) < sequenceCount && n < firstFound)
+	{
+		GenerateSequence(n, &ops);
+		RestoreBranch(&fm, &primed);
+		if (PlayFrom(&fm, ops, 0, NULL, NULL) < ops.size())
+		{
+			uint64_t found = firstFound;
+			while (n < found && !firstFound.compare_exchange_weak(found, n))
+			{
+			}
+		}
+	}
+}
+
+// Shrinks sequences, keeping the state before each operation of the current one so
+// every candidate can branch from where it first differs
+struct Shrinker
+{
+	FuzzMachines fm;
+	std::vector<SeqOp> ops;					// Smallest sequence found so far that disagrees
+	std::vector<FuzzBranch> branches;		// State before each of its operations
+};
+
+// Tries a smaller version of the sequence, which is the same as the current one up
+// to operation first. Keeps it if the machines still disagree.
+static bool TryShrink(Shrinker *s, const std::vector<SeqOp> &candidate, size_t first)
+{
+	std::vector<FuzzBranch> branches;
+
+	RestoreBranch(&s->fm, &s->branches[first]);
+	const size_t divergence = PlayFrom(&s->fm, candidate, first, &branches, NULL);
+	if (divergence == candidate.size())
+	{
+		return false;
+	}
+
+	s->ops.assign(candidate.begin(), candidate.begin() + divergence + 1);
+	s->branches.resize(s->ops.size());
+	for (size_t i = first + 1; i < s->ops.size(); i++)
+	{
+		s->branches[i] = branches[i];
+	}
+	return true;
+}
+
+// Shrinks a sequence the machines disagree on: first by dropping operations (big
+// runs of them, then smaller ones), then by making fills and waits shorter. Repeats
+// until nothing more can be taken away.
+static void Shrink(Shrinker *s)
+{
+	std::vector<SeqOp> candidate;
+	bool shrunk = true;
+
+	Prime(&s->fm);
+	s->branches.resize(1);
+	SaveBranch(&s->fm, &s->branches[0]);
+	TryShrink(s, s->ops, 0);
+	while (shrunk)
+	{
+		shrunk = false;
+		for (size_t chunk = s->ops.size() / 2; chunk >= 1; chunk /= 2)
+		{
+			for (size_t start = 0; start + chunk <= s->ops.size(); )
+			{
+				candidate = s->ops;
+				candidate.erase(candidate.begin() + start, candidate.begin() + start + chunk);
+				if (TryShrink(s, candidate, start))
+				{
+					shrunk = true;
+				}
+				else
+				{
+					start += chunk;
+				}
+			}
+		}
+
+		for (size_t i = 0; i < s->ops.size(); i++)
+		{
+			if (s->ops[i].type != SeqFill && s->ops[i].type != SeqWait)
+			{
+				continue;
+			}
+			for (uint16_t step = s->ops[i].value / 2; step > 0; step /= 2)
+			{
+				while (i < s->ops.size() && s->ops[i].value > step)
+				{
+					candidate = s->ops;
+					candidate[i].value -= step;
+					if (!TryShrink(s, candidate, i))
+					{
+						break;
+					}
+					shrunk = true;
+				}
+			}
+		}
+	}
+}
+
+// Saves a sequence with what each machine observed as comments, so the result from
+// the real Mac can be compared against both
+static void WriteSequence(FILE *f, Shrinker *s, uint64_t number)
+{
+	std::vector<uint16_t> observed[2];
+	Prime(&s->fm);
+	const size_t divergence = PlayFrom(&s->fm, s->ops, 0, NULL, observed);
+
+	fprintf(f, "# ASCTester sequence from ascfuzz (seed %llu, sequence %llu)\n",
+			(unsigned long long)fuzz.seed, (unsigned long long)number);
+	fprintf(f, "# %s and %s disagree on the last observation.\n", fuzz.profiles[0]->description,
+			fuzz.profiles[1]->description);
+	fprintf(f, "# Play it by saving it as \"ASCTester Sequence\" next to ASCTester.\n");
+	for (size_t i = 0; i < s->ops.size(); i++)
+	{
+		SeqWriteOp(f, &s->ops[i]);
+		if (SeqObserves(&s->ops[i]))
+		{
+			for (int j = 0; j < 2; j++)
+			{
+				if (s->ops[i].type == SeqWait)
+				{
+					fprintf(f, "%s%s: %u IRQs", j ? ", " : "\t# ", fuzz.profiles[j]->name, observed[j][i]);
+				}
+				else
+				{
+					fprintf(f, "%s%s: $%02X", j ? ", " : "\t# ", fuzz.profiles[j]->name, observed[j][i]);
+				}
+			}
+			if (i == divergence)
+			{
+				fprintf(f, " (differs)");
+			}
+		}
+		fprintf(f, "\n");
+	}
+}
+
+static const SimProfile *FindProfile(const char *name)
+{
+	const SimProfile *profile = SimFindProfile(name);
+	unsigned box, version;
+	if (!profile && sscanf(name, "%u:%x", &box, &version) == 2)
+	{
+		profile = SimFindProfileByID(box, version);
+	}
+	if (!profile)
+	{
+		fprintf(stderr, "Unknown profile: %s\n", name);
+	}
+	return profile;
+}
+
+// Plays a sequence file on each profile and prints what it observed, in the same
+// form ASCTester prints it on a real Mac
+static int Play(const char *path, int argc, char *argv[])
+{
+	static SeqOp ops[SEQ_MAX_OPS];
+	static uint16_t observed[SEQ_MAX_OPS];
+	static SimMachine m;
+	uint32_t count;
+
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		perror(path);
+		return 2;
+	}
+	const bool ok = SeqReadFile(f, ops, SEQ_MAX_OPS, &count);
+	fclose(f);
+	if (!ok)
+	{
+		return 2;
+	}
+
+	for (int i = 0; i < argc; i++)
+	{
+		const SimProfile *profile = FindProfile(argv[i]);
+		if (!profile)
+		{
+			return 2;
+		}
+		SimInit(&m, profile);
+		SimSetCurrent(&m);
+		SeqRun(ops, count, observed);
+
+		printf("=== %s (%s) ===\n", profile->description, profile->name);
+		printf("ASCTester sequence, BoxFlag: %u   ASC Version: $%02X\n", profile->boxFlag, profile->ascVariant->version);
+		for (uint32_t j = 0; j < count; j++)
+		{
+			SeqPrintObserved(stdout, &ops[j], observed[j]);
+		}
+		printf("\n");
+	}
+	return 0;
+}
+
+static void Usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-j jobs] [-n sequences] [-l length] [-s seed] [-i reg]... [-o file] profile1 profile2\n", argv0);
+	fprintf(stderr, "       %s -p sequence profile...\n", argv0);
+	fprintf(stderr, "Plays random register sequences on two machines until they disagree, then shrinks the\n");
+	fprintf(stderr, "sequence and writes it (to stdout, or the -o file) for ASCTester to play on a real Mac.\n");
+	fprintf(stderr, "Exits with 1 if the machines disagreed.\n");
+	fprintf(stderr, "  -j jobs       threads to use (default: one per CPU core)\n");
+	fprintf(stderr, "  -n sequences  sequences to try (default 100000)\n");
+	fprintf(stderr, "  -l length     operations per sequence (default 32)\n");
+	fprintf(stderr, "  -s seed       random seed (default 1)\n");
+	fprintf(stderr, "  -i reg        don't compare reads of an ASC register (hex), a VIA2 register (v followed\n");
+	fprintf(stderr, "                by hex), or IRQ counts (wait). Can be given more than once.\n");
+	fprintf(stderr, "-p plays a sequence file on each profile and prints what it observed.\n");
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int threads = std::thread::hardware_concurrency();
+	const char *outputPath = NULL;
+	std::vector<const SimProfile *> picked;
+
+	if (argc >= 4 && !strcmp(argv[1], "-p"))
+	{
+		return Play(argv[2], argc - 3, argv + 3);
+	}
+
+	sequenceCount = 100000;
+	fuzz.length = 32;
+	fuzz.seed = 1;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-j") && i + 1 < argc)
+		{
+			threads = atoi(argv[++i]);
+			continue;
+		}
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+		{
+			sequenceCount = strtoull(argv[++i], NULL, 0);
+			continue;
+		}
+		if (!strcmp(argv[i], "-l") && i + 1 < argc)
+		{
+			fuzz.length = strtoul(argv[++i], NULL, 0);
+			continue;
+		}
+		if (!strcmp(argv[i], "-s") && i + 1 < argc)
+		{
+			fuzz.seed = strtoull(argv[++i], NULL, 0);
+			continue;
+		}
+		if (!strcmp(argv[i], "-o") && i + 1 < argc)
+		{
+			outputPath = argv[++i];
+			continue;
+		}
+		if (!strcmp(argv[i], "-i") && i + 1 < argc)
+		{
+			const char *reg = argv[++i];
+			if (!strcmp(reg, "wait"))
+			{
+				fuzz.ignoreIRQCounts = true;
+			}
+			else if (reg[0] == 'v')
+			{
+				fuzz.ignoredVIA2.push_back((uint16_t)strtoul(reg + 1, NULL, 16));
+			}
+			else
+			{
+				fuzz.ignoredASC.push_back((uint16_t)strtoul(reg, NULL, 16));
+			}
+			continue;
+		}
+
+		const SimProfile *profile = (argv[i][0] != '-') ? FindProfile(argv[i]) : NULL;
+		if (!profile)
+		{
+			Usage(argv[0]);
+			return 2;
+		}
+		picked.push_back(profile);
+	}
+	if (picked.size() != 2 || fuzz.length < 1 || fuzz.length > SEQ_MAX_OPS)
+	{
+		Usage(argv[0]);
+		return 2;
+	}
+	fuzz.profiles[0] = picked[0];
+	fuzz.profiles[1] = picked[1];
+
+	if (threads < 1)
+	{
+		threads = 1;
+	}
+	nextSequence = 0;
+	firstFound = UINT64_MAX;
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < threads; i++)
+	{
+		workers.push_back(std::thread(Worker));
+	}
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const uint64_t played = (firstFound < sequenceCount) ? firstFound + 1 : sequenceCount;
+	fprintf(stderr, "%llu sequences, %llu register accesses in %.2f s (%.0f accesses/s on %u threads)\n",
+			(unsigned long long)played, (unsigned long long)accesses.load(), seconds,
+			seconds > 0 ? accesses / seconds : 0.0, threads);
+	if (firstFound == UINT64_MAX)
+	{
+		fprintf(stderr, "%s and %s agreed on every sequence\n", fuzz.profiles[0]->description,
+				fuzz.profiles[1]->description);
+		return 0;
+	}
+
+	static Shrinker shrinker;
+	GenerateSequence(firstFound, &shrinker.ops);
+	Shrink(&shrinker);
+	fprintf(stderr, "Sequence %llu disagrees; shrunk to %u operations\n", (unsigned long long)firstFound.load(),
+			(unsigned)shrinker.ops.size());
+
+	FILE *f = outputPath ? fopen(outputPath, "w") : stdout;
+	if (!f)
+	{
+		perror(outputPath);
+		return 2;
+	}
+	WriteSequence(f, &shrinker, firstFound);
+	if (outputPath)
+	{
+		fclose(f);
+	}
+	return 1;
+}
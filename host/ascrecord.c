@@ -0,0 +1,180 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "tests.h"
+
+// Decodes and compares the result records that ASCTester saves next to its report
+
+// A record as raw key=value pairs, so keys this tool doesn't know about still show up
+struct RawRecord
+{
+	int version;
+	std::vector<std::string> keys;
+	std::vector<std::string> values;
+};
+
+// Reads every record in a file as raw key=value pairs
+static bool ReadRawRecords(const char *path, std::vector<RawRecord> *records)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		perror(path);
+		return false;
+	}
+
+	char line[256];
+	RawRecord *r = NULL;
+	while (fgets(line, sizeof(line), f))
+	{
+		line[strcspn(line, "\r\n")] = 0;
+		int version;
+		if (sscanf(line, "ASCTesterResults %d", &version) == 1)
+		{
+			records->push_back(RawRecord());
+			r = &records->back();
+			r->version = version;
+		}
+		else if (r && !strcmp(line, "end"))
+		{
+			r = NULL;
+		}
+		else if (r && strchr(line, '='))
+		{
+			char *equals = strchr(line, '=');
+			*equals = 0;
+			r->keys.push_back(line);
+			r->values.push_back(equals + 1);
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+// Looks up a key in a raw record. Returns NULL if it isn't there.
+static const std::string *FindValue(const RawRecord &r, const std::string &key)
+{
+	for (size_t i = 0; i < r.keys.size(); i++)
+	{
+		if (r.keys[i] == key)
+		{
+			return &r.values[i];
+		}
+	}
+	return NULL;
+}
+
+// Prints the human readable report for every record in a file
+static int Show(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		perror(path);
+		return 2;
+	}
+
+	TestResults r;
+	int count = 0;
+	while (ReadResultRecord(f, &r))
+	{
+		if (count++)
+		{
+			printf("\n");
+		}
+		PrintResults(&r);
+		printf("\n");
+		PrintMeasurements(&r);
+	}
+	fclose(f);
+
+	if (!count)
+	{
+		fprintf(stderr, "%s: no records this version of ascrecord can read\n", path);
+		return 2;
+	}
+	return 0;
+}
+
+// Compares the records in two files key by key, pairing them up in order
+static int Diff(const char *pathA, const char *pathB)
+{
+	std::vector<RawRecord> a, b;
+	if (!ReadRawRecords(pathA, &a) || !ReadRawRecords(pathB, &b))
+	{
+		return 2;
+	}
+	if (a.size() != b.size())
+	{
+		printf("%s has %u records, %s has %u\n", pathA, (unsigned)a.size(), pathB, (unsigned)b.size());
+	}
+
+	int differences = 0;
+	const size_t count = (a.size() < b.size()) ? a.size() : b.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		const char *prefix = "";
+		char recordName[32] = "";
+		if (count > 1)
+		{
+			snprintf(recordName, sizeof(recordName), "record %u: ", (unsigned)i + 1);
+			prefix = recordName;
+		}
+
+		if (a[i].version != b[i].version)
+		{
+			printf("%sformat version %d -> %d\n", prefix, a[i].version, b[i].version);
+			differences++;
+		}
+		for (size_t k = 0; k < a[i].keys.size(); k++)
+		{
+			const std::string *other = FindValue(b[i], a[i].keys[k]);
+			if (!other)
+			{
+				printf("%s%s=%s -> (missing)\n", prefix, a[i].keys[k].c_str(), a[i].values[k].c_str());
+				differences++;
+			}
+			else if (*other != a[i].values[k])
+			{
+				printf("%s%s=%s -> %s\n", prefix, a[i].keys[k].c_str(), a[i].values[k].c_str(), other->c_str());
+				differences++;
+			}
+		}
+		for (size_t k = 0; k < b[i].keys.size(); k++)
+		{
+			if (!FindValue(a[i], b[i].keys[k]))
+			{
+				printf("%s%s=(missing) -> %s\n", prefix, b[i].keys[k].c_str(), b[i].values[k].c_str());
+				differences++;
+			}
+		}
+	}
+
+	return (differences || a.size() != b.size()) ? 1 : 0;
+}
+
+static void Usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s show record\n", argv0);
+	fprintf(stderr, "       %s diff record1 record2\n", argv0);
+	fprintf(stderr, "show prints the report for each record in the file.\n");
+	fprintf(stderr, "diff lists every key whose value differs. It exits with 1 if any do.\n");
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 3 && !strcmp(argv[1], "show"))
+	{
+		return Show(argv[2]);
+	}
+	if (argc == 4 && !strcmp(argv[1], "diff"))
+	{
+		return Diff(argv[2], argv[3]);
+	}
+	Usage(argv[0]);
+	return 2;
+}
@@ -0,0 +1,175 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "tracefile.h"
+
+// Looks at trace files saved by ASCTester and replays them against the simulated machine
+
+// Events shown before the one a replay diverged on
+#define REPLAY_CONTEXT				16
+
+static void PrintEvent(const TraceFile *tf, uint32_t i)
+{
+	TraceEvent e;
+	TraceFileEvent(tf, i, &e);
+	printf("%10u %10u  %s %-3s %s $%03X = $%02X\n", i, e.time, (e.flags & TraceIRQ) ? "irq" : "   ",
+			(e.flags & TraceVIA2) ? "VIA" : "ASC", (e.flags & TraceWrite) ? "W" : "R", e.address, e.value);
+}
+
+static int Info(const char *path)
+{
+	TraceFile tf;
+	if (!TraceFileOpen(&tf, path))
+	{
+		return 2;
+	}
+
+	uint32_t writes = 0, via2 = 0, irq = 0;
+	TraceEvent first = {}, last = {};
+	for (uint32_t i = 0; i < tf.count; i++)
+	{
+		TraceEvent e;
+		TraceFileEvent(&tf, i, &e);
+		writes += (e.flags & TraceWrite) ? 1 : 0;
+		via2 += (e.flags & TraceVIA2) ? 1 : 0;
+		irq += (e.flags & TraceIRQ) ? 1 : 0;
+		if (i == 0)
+		{
+			first = e;
+		}
+		last = e;
+	}
+
+	printf("Format version: %u\n", tf.version);
+	printf("Time unit: %u ns\n", tf.timeUnitNs);
+	printf("Events: %u (%u dropped)\n", tf.count, tf.dropped);
+	printf("Writes: %u  VIA2: %u  In IRQ handlers: %u\n", writes, via2, irq);
+	printf("Time: %u to %u (%.3f s)\n", first.time, last.time,
+			(double)(last.time - first.time) * tf.timeUnitNs / SIM_NS_PER_SEC);
+	if (tf.indexInterval)
+	{
+		printf("Index: every %u events\n", tf.indexInterval);
+	}
+	else
+	{
+		printf("Index: none\n");
+	}
+	TraceFileClose(&tf);
+	return 0;
+}
+
+// Prints the events between two times (inclusive), or all of them
+static int Dump(const char *path, int argc, char *argv[])
+{
+	TraceFile tf;
+	if (!TraceFileOpen(&tf, path))
+	{
+		return 2;
+	}
+
+	const uint32_t start = (argc > 0) ? strtoul(argv[0], NULL, 0) : 0;
+	const uint32_t end = (argc > 1) ? strtoul(argv[1], NULL, 0) : UINT32_MAX;
+	for (uint32_t i = TraceFileFind(&tf, start); i < tf.count; i++)
+	{
+		TraceEvent e;
+		TraceFileEvent(&tf, i, &e);
+		if (e.time > end)
+		{
+			break;
+		}
+		PrintEvent(&tf, i);
+	}
+	TraceFileClose(&tf);
+	return 0;
+}
+
+// Replays a trace against a profile and reports the first place the model disagrees
+static int Replay(const char *path, const char *profileName)
+{
+	const SimProfile *profile = SimFindProfile(profileName);
+	unsigned box, version;
+	if (!profile && sscanf(profileName, "%u:%x", &box, &version) == 2)
+	{
+		profile = SimFindProfileByID(box, version);
+	}
+	if (!profile)
+	{
+		fprintf(stderr, "Unknown profile: %s\n", profileName);
+		return 2;
+	}
+
+	TraceFile tf;
+	if (!TraceFileOpen(&tf, path))
+	{
+		return 2;
+	}
+	if (tf.dropped)
+	{
+		printf("Warning: %u events didn't fit in the capture buffer; only the start was saved\n", tf.dropped);
+	}
+
+	static SimMachine m;
+	SimInit(&m, profile);
+	SimReplayResult result;
+	SimReplay(&m, &tf, &result);
+
+	int status = 0;
+	if (result.diverged)
+	{
+		TraceEvent e;
+		TraceFileEvent(&tf, result.divergedAt, &e);
+		printf("%s diverges from %s at event %u (time %u): %s\n", path, profile->description,
+				result.divergedAt, e.time, result.reason);
+		if (result.comparedBits)
+		{
+			printf("%s $%03X: trace $%02X, model $%02X (compared bits $%02X)\n", (e.flags & TraceVIA2) ? "VIA2" : "ASC",
+					e.address, e.value, result.modelValue, result.comparedBits);
+		}
+		printf("\n");
+		const uint32_t first = (result.divergedAt > REPLAY_CONTEXT) ? result.divergedAt - REPLAY_CONTEXT : 0;
+		for (uint32_t i = first; i <= result.divergedAt; i++)
+		{
+			PrintEvent(&tf, i);
+		}
+		status = 1;
+	}
+	else
+	{
+		printf("%s matches %s: %u events, %u reads compared\n", path, profile->description,
+				result.events, result.readsCompared);
+	}
+	TraceFileClose(&tf);
+	return status;
+}
+
+static void Usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s info trace\n", argv0);
+	fprintf(stderr, "       %s dump trace [start [end]]\n", argv0);
+	fprintf(stderr, "       %s replay trace profile | boxflag:ascversion\n", argv0);
+	fprintf(stderr, "info summarizes the trace.\n");
+	fprintf(stderr, "dump prints the events, optionally only those from start to end (in trace time units).\n");
+	fprintf(stderr, "replay runs the trace against a simulated machine and shows where it first reads\n");
+	fprintf(stderr, "something different. It exits with 1 if it does.\n");
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 3 && !strcmp(argv[1], "info"))
+	{
+		return Info(argv[2]);
+	}
+	if (argc >= 3 && argc <= 5 && !strcmp(argv[1], "dump"))
+	{
+		return Dump(argv[2], argc - 3, argv + 3);
+	}
+	if (argc == 4 && !strcmp(argv[1], "replay"))
+	{
+		return Replay(argv[2], argv[3]);
+	}
+	Usage(argv[0]);
+	return 2;
+}
@@ -0,0 +1,227 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "sim.h"
+#include "tests.h"
+#include "trace.h"
+
+// CPU speed variations run by -s. Each one scales the profile's CPU timings.
+static const struct
+{
+	const char *suffix;
+	unsigned int numerator;
+	unsigned int denominator;
+} cpuVariations[] =
+{
+	{ "slowcpu", 2, 1 },
+	{ "fastcpu", 1, 2 },
+};
+
+// One run of the test suite against one machine configuration. Every job has its own
+// machine and results, so jobs can run on any thread.
+struct HostJob
+{
+	SimProfile profile;						// Copy of the profile, possibly with varied parameters
+	char name[64];							// Name of this configuration
+	SimMachine machine;						// Machine the tests run against
+	TestResults results;					// What the tests found
+};
+
+// Most events a host trace can hold
+#define HOST_TRACE_CAPACITY			(1UL << 22)
+
+static std::vector<HostJob> jobs;
+static std::atomic<size_t> nextJob;
+static const char *traceDir;
+
+// Adds a job for a profile, scaling its CPU timings by numerator/denominator
+static void AddJob(const SimProfile *profile, const char *suffix, unsigned int numerator, unsigned int denominator)
+{
+	HostJob job;
+	job.profile = *profile;
+	job.profile.readNs = profile->readNs * numerator / denominator;
+	job.profile.writeNs = profile->writeNs * numerator / denominator;
+	job.profile.pollNs = profile->pollNs * numerator / denominator;
+	job.profile.irqEntryNs = profile->irqEntryNs * numerator / denominator;
+	snprintf(job.name, sizeof(job.name), "%s%s%s", profile->name, suffix ? "-" : "", suffix ? suffix : "");
+	jobs.push_back(job);
+}
+
+// Adds a job for a profile, plus its variations if asked for
+static void AddJobs(const SimProfile *profile, bool variations)
+{
+	AddJob(profile, NULL, 1, 1);
+	if (variations)
+	{
+		for (size_t i = 0; i < sizeof(cpuVariations)/sizeof(cpuVariations[0]); i++)
+		{
+			AddJob(profile, cpuVariations[i].suffix, cpuVariations[i].numerator, cpuVariations[i].denominator);
+		}
+	}
+}
+
+// Keeps taking jobs until they've all been run
+static void Worker(void)
+{
+	size_t i;
+	while ((i = nextJob++) < jobs.size())
+	{
+		HostJob *job = &jobs[i];
+		TraceBuffer trace;
+		if (traceDir)
+		{
+			if (!TraceAlloc(&trace, HOST_TRACE_CAPACITY, 1000))
+			{
+				fprintf(stderr, "Not enough memory for a trace of %s\n", job->name);
+				exit(1);
+			}
+			traceBuffer = &trace;
+		}
+
+		SimInit(&job->machine, &job->profile);
+		SimSetCurrent(&job->machine);
+		DoTests(&job->results);
+
+		if (traceDir)
+		{
+			traceBuffer = NULL;
+			char path[1024];
+			snprintf(path, sizeof(path), "%s/%s.trace", traceDir, job->name);
+			FILE *f = fopen(path, "wb");
+			if (!f || !TraceWriteFile(&trace, f))
+			{
+				perror(path);
+				exit(1);
+			}
+			fclose(f);
+			TraceFree(&trace);
+		}
+	}
+}
+
+static void Usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-l] [-s] [-j jobs] [-r dir] [-t dir] [profile | boxflag:ascversion ...]\n", argv0);
+	fprintf(stderr, "Runs every profile if none are given. -l lists the profiles.\n");
+	fprintf(stderr, "-s also runs each profile with its CPU half and twice as fast.\n");
+	fprintf(stderr, "-j sets how many profiles run at once (default: one per core).\n");
+	fprintf(stderr, "-r also saves each profile's result record as dir/name.rec.\n");
+	fprintf(stderr, "-t also saves a trace of each profile's register accesses as dir/name.trace.\n");
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int threads = std::thread::hardware_concurrency();
+	bool variations = false;
+	bool listed = false;
+	const char *recordDir = NULL;
+	std::vector<const SimProfile *> picked;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-l"))
+		{
+			for (size_t j = 0; j < simProfileCount; j++)
+			{
+				printf("%-14s BoxFlag %3d  ASC $%02X  %s\n", simProfiles[j].name, simProfiles[j].boxFlag,
+						simProfiles[j].ascVariant->version, simProfiles[j].description);
+			}
+			listed = true;
+			continue;
+		}
+		if (!strcmp(argv[i], "-s"))
+		{
+			variations = true;
+			continue;
+		}
+		if (!strcmp(argv[i], "-j") && i + 1 < argc)
+		{
+			threads = atoi(argv[++i]);
+			continue;
+		}
+		if (!strcmp(argv[i], "-r") && i + 1 < argc)
+		{
+			recordDir = argv[++i];
+			continue;
+		}
+		if (!strcmp(argv[i], "-t") && i + 1 < argc)
+		{
+			traceDir = argv[++i];
+			continue;
+		}
+
+		const SimProfile *profile = SimFindProfile(argv[i]);
+		unsigned int box, version;
+		if (!profile && sscanf(argv[i], "%u:%x", &box, &version) == 2)
+		{
+			profile = SimFindProfileByID(box, version);
+		}
+		if (!profile)
+		{
+			fprintf(stderr, "Unknown option or profile: %s\n", argv[i]);
+			Usage(argv[0]);
+			return 1;
+		}
+		picked.push_back(profile);
+	}
+
+	if (picked.empty() && !listed)
+	{
+		for (size_t i = 0; i < simProfileCount; i++)
+		{
+			picked.push_back(&simProfiles[i]);
+		}
+	}
+	for (size_t i = 0; i < picked.size(); i++)
+	{
+		AddJobs(picked[i], variations);
+	}
+
+	// Run the jobs on all the worker threads, then print in order
+	if (threads < 1)
+	{
+		threads = 1;
+	}
+	if (threads > jobs.size())
+	{
+		threads = (unsigned int)jobs.size();
+	}
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < threads; i++)
+	{
+		workers.push_back(std::thread(Worker));
+	}
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		printf("=== %s (%s) ===\n", jobs[i].profile.description, jobs[i].name);
+		PrintResults(&jobs[i].results);
+		printf("\n");
+		PrintMeasurements(&jobs[i].results);
+		printf("\n");
+
+		if (recordDir)
+		{
+			char path[1024];
+			snprintf(path, sizeof(path), "%s/%s.rec", recordDir, jobs[i].name);
+			FILE *f = fopen(path, "w");
+			if (!f)
+			{
+				perror(path);
+				return 1;
+			}
+			WriteResultRecord(f, &jobs[i].results);
+			fclose(f);
+		}
+	}
+	return 0;
+}
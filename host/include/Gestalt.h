@@ -0,0 +1,51 @@
+#ifndef HOST_GESTALT_H
+#define HOST_GESTALT_H
+
+// Minimal stand-ins for the Toolbox declarations tests.c uses, so the
+// unchanged test code can be compiled for the host. The simulated machine
+// in host/ provides the implementations.
+
+#include <stdint.h>
+
+typedef int16_t OSErr;
+typedef uint32_t OSType;
+typedef long (*ProcPtr)(void);
+
+enum
+{
+	noErr = 0,
+	gestaltUndefSelectorErr = -5551
+};
+
+#define gestaltSystemVersion	'sysv'
+
+struct QElem
+{
+	struct QElem *qLink;
+	int16_t qType;
+};
+typedef struct QElem QElem;
+typedef QElem *QElemPtr;
+
+struct QHdr
+{
+	int16_t qFlags;
+	QElemPtr qHead;
+	QElemPtr qTail;
+};
+typedef struct QHdr QHdr;
+
+struct VBLTask
+{
+	QElemPtr qLink;
+	int16_t qType;
+	ProcPtr vblAddr;
+	int16_t vblCount;
+	int16_t vblPhase;
+};
+typedef struct VBLTask VBLTask;
+
+OSErr Gestalt(OSType selector, long *response);
+QHdr LMGetVBLQueue(void);
+
+#endif
@@ -0,0 +1,105 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sim.h"
+
+// First bytes of the Sound Manager's ASC VBL task on the Quadra 700/900
+static const uint8_t ascVBLTaskCode[10] =
+{
+	0x31, 0x7C, 0x00, 0x1E, 0x00, 0x0A,
+	0x22, 0x78, 0x0C, 0xC0
+};
+
+// Stands in for the OS's own ASC interrupt handler. Nothing is listening to it,
+// so it clears the IRQ and turns it off.
+static void SimDefaultASCHandler(void)
+{
+	SimMachine *m = SimCurrent();
+	(void)SimASCRead(m, 0x804);
+	SimVIA2Write(m, 0x1C13, SIM_VIA2_ASC_BIT);
+	SimVIA2Write(m, 0x1A03, 0x80 | SIM_VIA2_ASC_BIT);
+}
+
+// Initializes a machine to its power-on state
+void SimInit(SimMachine *m, const SimProfile *profile)
+{
+	memset(m, 0, sizeof(*m));
+	m->profile = profile;
+	m->via2Handlers[4] = SimDefaultASCHandler;
+	m->ascVBLTask.vblAddr = (ProcPtr)ascVBLTaskCode;
+	m->ascVBLTask.vblCount = 30;
+	SimASCReset(m);
+	SimVIA2Reset(m);
+}
+
+// Lets virtual time pass, playing any samples that are due
+void SimAdvance(SimMachine *m, uint64_t ns)
+{
+	m->timeNs += ns;
+	SimASCCatchUp(m);
+}
+
+// Runs the ASC IRQ handler for as long as VIA2 keeps requesting it and the CPU's
+// interrupt mask allows it
+void SimCheckIRQ(SimMachine *m)
+{
+	const SimProfile *p = m->profile;
+
+	while (((m->sr >> 8) & 7) < SIM_VIA2_IPL && SimVIA2IRQPending(m) &&
+		m->timeNs >= m->via2.ascFlaggedNs + p->irqLatencyNs)
+	{
+		const uint16_t sr = m->sr;
+		m->sr = (sr & ~0x0700) | (SIM_VIA2_IPL << 8);
+		SimAdvance(m, p->irqEntryNs);
+		m->via2Handlers[4]();
+		m->sr = sr;
+	}
+}
+
+// Virtual time of the next thing that can change what the tests observe: a FIFO
+// status change, or a pending IRQ becoming deliverable
+uint64_t SimNextEventNs(const SimMachine *m)
+{
+	uint64_t next = SimASCNextEventNs(m);
+
+	if (((m->sr >> 8) & 7) < SIM_VIA2_IPL && SimVIA2IRQPending(m))
+	{
+		const uint64_t deliverNs = m->via2.ascFlaggedNs + m->profile->irqLatencyNs;
+		if (deliverNs < next)
+		{
+			next = deliverNs;
+		}
+	}
+
+	return next;
+}
+
+// Skips virtual time ahead to the next event (but no further than limitNs),
+// since nothing the tests can observe changes before then
+void SimFastForward(SimMachine *m, uint64_t limitNs)
+{
+	uint64_t target = SimNextEventNs(m);
+	if (target > limitNs)
+	{
+		target = limitNs;
+	}
+	if (target <= m->timeNs)
+	{
+		target = m->timeNs + m->profile->pollNs;
+	}
+
+	SimAdvance(m, target - m->timeNs);
+	SimCheckIRQ(m);
+}
+
+// Saves the machine's state so it can be restored later
+void SimSave(const SimMachine *m, SimSnapshot *s)
+{
+	s->machine = *m;
+}
+
+// Puts a machine back into a saved state
+void SimRestore(SimMachine *m, const SimSnapshot *s)
+{
+	*m = s->machine;
+}
@@ -0,0 +1,203 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <Gestalt.h>
+#include "asctester.h"
+
+// Size of the ASC and VIA2 address spaces decoded by the simulated machine
+#define SIM_ASC_SPACE				0x1000
+#define SIM_VIA2_SPACE				0x2000
+
+// FIFO geometry shared by every ASC variant
+#define SIM_FIFO_SIZE				0x400
+#define SIM_FIFO_HALF				(SIM_FIFO_SIZE / 2)
+
+// Playback rate of the FIFOs (22.257 kHz)
+#define SIM_SAMPLE_RATE				22257
+#define SIM_NS_PER_SEC				1000000000ULL
+
+// VIA clock, which the VIA1 timers count down at (783.36 kHz)
+#define SIM_VIA_CLOCK				783360
+
+// Length of one 60 Hz tick in virtual nanoseconds
+#define SIM_TICK_NS					(SIM_NS_PER_SEC / 60)
+
+// Interrupt priority level the VIA2 interrupt arrives at
+#define SIM_VIA2_IPL				2
+
+// VIA2 interrupt flag bit the ASC is wired to (CB1)
+#define SIM_VIA2_ASC_BIT			0x10
+
+// Returned when nothing is scheduled to happen
+#define SIM_NO_EVENT				UINT64_MAX
+
+// How register $804 behaves
+enum SimStatusType
+{
+	SimStatusLatched,						// Original ASC: bits latch when the FIFO becomes full or drops to
+											// half empty and are cleared by reading the register
+	SimStatusLevel							// Later variants: bits show the current FIFO level
+};
+
+// How VIA2 (or whatever stands in for it) sees the ASC interrupt line
+enum SimVIA2IRQType
+{
+	SimVIA2IRQEdge,							// The flag latches on a rising edge and stays set until acknowledged
+	SimVIA2IRQLevel							// The flag simply follows the line; acknowledging it does nothing
+};
+
+// Describes how one ASC variant (identified by the value of register $800) behaves
+struct SimASCVariant
+{
+	uint8_t version;						// Value of ASC register $800
+	uint8_t modesAccepted;					// Bit n set if register $801 accepts mode n
+	uint8_t initialMode;					// Initial value of register $801
+	bool stereoBitWritable;					// Bit 1 of register $802 can be changed
+	bool alwaysStereo;						// Both FIFOs play regardless of register $802
+	bool hasF09;							// Register $F09 exists
+	bool hasF29;							// Register $F29 exists (0 = ASC IRQ enabled)
+	uint8_t initialF09;						// Initial value of register $F09
+	uint8_t initialF29;						// Initial value of register $F29
+	SimStatusType statusType;				// How register $804 behaves
+	uint8_t statusForceOn;					// Bits of $804 that always read as 1
+	uint8_t statusForceOff;					// Bits of $804 that always read as 0
+	uint8_t irqStatusMask;					// Bits of $804 that drive the IRQ line
+	uint16_t fullLevel;						// FIFO level at which the full flag turns on
+};
+
+// Describes one machine: its ASC variant, how VIA2 behaves, and what the OS reports.
+// The CPU timing values are calibrated so each machine reproduces its known-good results.
+struct SimProfile
+{
+	const char *name;						// Short name used to pick the profile
+	const char *description;				// Human readable machine name
+	uint8_t boxFlag;						// Machine identifier byte
+	const SimASCVariant *ascVariant;		// ASC variant in this machine
+	long sysVersion;						// System version reported by Gestalt
+	uint32_t addrMapFlags;					// Value of the AddrMapFlags low-memory global
+	bool hasASCVBLTask;						// The Sound Manager installs the Quadra 700/900 ASC VBL task
+	uint16_t via2DecodeMask;				// Address bits decoded inside the first $200 bytes of VIA2
+											// (0 = real VIA with a register every $200 bytes)
+	SimVIA2IRQType via2IRQType;				// How VIA2 latches the ASC IRQ
+	uint32_t readNs;						// Virtual time consumed by a register read
+	uint32_t writeNs;						// Virtual time consumed by a register write
+	uint32_t pollNs;						// Virtual time consumed by a ticks() poll
+	uint32_t irqLatencyNs;					// Time between VIA2 flagging an IRQ and the CPU taking it
+	uint32_t irqEntryNs;					// Time spent entering and leaving the IRQ handler
+};
+
+// One of the two playback FIFOs
+struct SimFIFO
+{
+	uint8_t data[SIM_FIFO_SIZE];			// Ring buffer contents
+	uint16_t readPos;						// Index of the next sample to be played
+	uint16_t count;							// Number of samples waiting to be played
+};
+
+// State of the simulated ASC
+struct SimASC
+{
+	SimFIFO fifo[2];						// FIFO A and FIFO B
+	uint8_t mode;							// Register $801
+	uint8_t control;						// Register $802
+	uint8_t fifoMode;						// Register $803
+	uint8_t latchedStatus;					// Latched $804 bits (SimStatusLatched only)
+	uint8_t regs[0x100];					// Other registers in $800-$8FF that simply hold a value
+	uint8_t f09;							// Register $F09 (if it exists)
+	uint8_t f29;							// Register $F29 (if it exists)
+	uint64_t samplesPlayed;					// Sample periods elapsed as of the last catch-up
+	uint64_t nextSampleNs;					// Virtual time at which the next sample period ends
+};
+
+// State of the simulated VIA2
+struct SimVIA2
+{
+	uint8_t ier;							// Interrupt enable register
+	uint8_t ifr;							// Interrupt flag register
+	bool ascLine;							// Last observed level of the ASC IRQ line
+	uint64_t ascFlaggedNs;					// Virtual time at which the ASC flag was last set
+};
+
+// State of one simulated machine. Everything the backend interface touches lives here.
+struct SimMachine
+{
+	const SimProfile *profile;				// Machine being simulated
+	uint64_t timeNs;						// Virtual time since the machine was created
+	uint16_t sr;							// 68k status register (only the IPL bits matter)
+	SimASC asc;								// ASC state
+	SimVIA2 via2;							// VIA2 state
+	VIA2Handler via2Handlers[8];			// VIA2 dispatch table
+	void *applScratch;						// Stand-in for the ApplScratch low-memory global
+	VBLTask ascVBLTask;						// Fake copy of the Sound Manager's ASC VBL task
+	uint32_t pollsSinceTicks;				// ticksElapsed() polls since the tests last read ticks()
+};
+
+// A copy of everything a machine does, for running several branches from the same
+// point: FIFO contents, status latches, IRQ lines, and the virtual clock among it.
+// Pointers in the machine (such as ApplScratch) are copied as they are.
+struct SimSnapshot
+{
+	SimMachine machine;
+};
+
+// Outcome of replaying a captured trace against the model
+struct SimReplayResult
+{
+	uint32_t events;						// Events replayed
+	uint32_t readsCompared;					// Reads whose value was checked against the model
+	bool diverged;							// The model disagreed with the trace
+	uint32_t divergedAt;					// (Only if diverged) index of the event it disagreed on
+	uint8_t modelValue;						// (Only if diverged) what the model read instead
+	uint8_t comparedBits;					// (Only if diverged) bits of the value that were compared
+	const char *reason;						// (Only if diverged) what went wrong
+};
+
+struct TraceFile;
+
+// Profiles
+extern const SimProfile simProfiles[];
+extern const size_t simProfileCount;
+const SimProfile *SimFindProfile(const char *name);
+const SimProfile *SimFindProfileByID(uint8_t boxFlag, uint8_t ascVersion);
+
+// Machine
+void SimInit(SimMachine *m, const SimProfile *profile);
+void SimAdvance(SimMachine *m, uint64_t ns);
+void SimCheckIRQ(SimMachine *m);
+uint64_t SimNextEventNs(const SimMachine *m);
+void SimFastForward(SimMachine *m, uint64_t limitNs);
+void SimSave(const SimMachine *m, SimSnapshot *s);
+void SimRestore(SimMachine *m, const SimSnapshot *s);
+
+// ASC
+void SimASCReset(SimMachine *m);
+void SimASCCatchUp(SimMachine *m);
+uint64_t SimASCNextEventNs(const SimMachine *m);
+uint8_t SimASCPeek(const SimMachine *m, uint16_t offset);
+uint8_t SimASCRead(SimMachine *m, uint16_t offset);
+uint8_t SimASCModeledBits(const SimMachine *m, uint16_t offset);
+void SimASCWrite(SimMachine *m, uint16_t offset, uint8_t value);
+bool SimASCIRQLine(const SimMachine *m);
+
+// VIA2
+void SimVIA2Reset(SimMachine *m);
+uint8_t SimVIA2Read(SimMachine *m, uint16_t offset);
+void SimVIA2Write(SimMachine *m, uint16_t offset, uint8_t value);
+uint8_t SimVIA2ModeledBits(const SimMachine *m, uint16_t offset);
+void SimVIA2UpdateASCLine(SimMachine *m, uint64_t whenNs);
+bool SimVIA2IRQPending(const SimMachine *m);
+
+// VIA1 (just the timers)
+uint8_t SimVIA1Read(const SimMachine *m, uint16_t offset);
+
+// Replay
+void SimReplay(SimMachine *m, const TraceFile *tf, SimReplayResult *result);
+
+// The machine the backend interface currently talks to
+void SimSetCurrent(SimMachine *m);
+SimMachine *SimCurrent(void);
+
+#endif
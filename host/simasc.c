@@ -0,0 +1,334 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sim.h"
+
+// Virtual time at which sample period n ends
+static uint64_t SampleTimeNs(uint64_t n)
+{
+	return n * SIM_NS_PER_SEC / SIM_SAMPLE_RATE;
+}
+
+// Whether FIFO B is playing alongside FIFO A
+static bool IsStereo(const SimMachine *m)
+{
+	return m->profile->ascVariant->alwaysStereo || (m->asc.control & 0x02);
+}
+
+// Computes the $804 bits from the current FIFO levels
+static uint8_t LevelStatus(const SimMachine *m)
+{
+	uint8_t status = 0;
+	for (int i = 0; i < 2; i++)
+	{
+		const uint16_t count = m->asc.fifo[i].count;
+		if (count <= SIM_FIFO_HALF)
+		{
+			status |= 0x01 << (i * 2);
+		}
+		if (count >= m->profile->ascVariant->fullLevel || count == 0)
+		{
+			status |= 0x02 << (i * 2);
+		}
+	}
+	return status;
+}
+
+// Current value of register $804, without any side effects of reading it
+static uint8_t Status(const SimMachine *m)
+{
+	const SimASCVariant *p = m->profile->ascVariant;
+	uint8_t status = (p->statusType == SimStatusLatched) ? m->asc.latchedStatus : LevelStatus(m);
+	status |= p->statusForceOn;
+	status &= ~p->statusForceOff;
+	return status;
+}
+
+// Plays up to the given number of samples out of a FIFO at once
+static void DrainFIFO(SimMachine *m, int i, uint64_t samples)
+{
+	SimFIFO *f = &m->asc.fifo[i];
+	const uint16_t played = (samples < f->count) ? (uint16_t)samples : f->count;
+	if (played == 0)
+	{
+		return;
+	}
+
+	const uint16_t oldCount = f->count;
+	f->readPos = (f->readPos + played) % SIM_FIFO_SIZE;
+	f->count -= played;
+	if (oldCount > SIM_FIFO_HALF && f->count <= SIM_FIFO_HALF)
+	{
+		m->asc.latchedStatus |= 0x01 << (i * 2);
+	}
+}
+
+// Puts a sample into a FIFO. It's dropped if the FIFO is full.
+static void QueueSample(SimMachine *m, int i, uint8_t value)
+{
+	SimFIFO *f = &m->asc.fifo[i];
+	if (f->count >= SIM_FIFO_SIZE)
+	{
+		return;
+	}
+
+	f->data[(f->readPos + f->count) % SIM_FIFO_SIZE] = value;
+	f->count++;
+	if (f->count == m->profile->ascVariant->fullLevel)
+	{
+		m->asc.latchedStatus |= 0x02 << (i * 2);
+	}
+}
+
+// Empties both FIFOs
+static void ClearFIFOs(SimMachine *m)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		m->asc.fifo[i].readPos = 0;
+		m->asc.fifo[i].count = 0;
+	}
+}
+
+// Puts the ASC into its power-on state
+void SimASCReset(SimMachine *m)
+{
+	const SimASCVariant *p = m->profile->ascVariant;
+	memset(&m->asc, 0, sizeof(m->asc));
+	m->asc.mode = p->initialMode;
+	m->asc.f09 = p->initialF09;
+	m->asc.f29 = p->initialF29;
+	m->asc.samplesPlayed = m->timeNs * SIM_SAMPLE_RATE / SIM_NS_PER_SEC;
+	m->asc.nextSampleNs = SampleTimeNs(m->asc.samplesPlayed + 1);
+}
+
+// Number of sample periods until a playing FIFO's status bits change (leaving
+// full, reaching half empty, or running dry), or UINT64_MAX if none will
+static uint64_t SamplesUntilChange(const SimMachine *m)
+{
+	uint64_t samples = UINT64_MAX;
+	for (int i = 0; i < (IsStereo(m) ? 2 : 1); i++)
+	{
+		const uint16_t count = m->asc.fifo[i].count;
+		const uint16_t fullLevel = m->profile->ascVariant->fullLevel;
+		uint64_t untilChange;
+		if (count == 0)
+		{
+			continue;
+		}
+		else if (count >= fullLevel)
+		{
+			untilChange = count - fullLevel + 1;
+		}
+		else if (count > SIM_FIFO_HALF)
+		{
+			untilChange = count - SIM_FIFO_HALF;
+		}
+		else
+		{
+			untilChange = count;
+		}
+
+		if (untilChange < samples)
+		{
+			samples = untilChange;
+		}
+	}
+	return samples;
+}
+
+// Plays every sample whose period has ended by the current virtual time. Rather
+// than stepping through each sample, this jumps from one status change to the
+// next, so the cost doesn't depend on how much time has passed.
+void SimASCCatchUp(SimMachine *m)
+{
+	// Most accesses (IRQ floods in particular) happen within a single sample period
+	if (m->timeNs < m->asc.nextSampleNs)
+	{
+		return;
+	}
+
+	// Last sample period n for which SampleTimeNs(n) <= timeNs
+	const uint64_t due = ((m->timeNs + 1) * SIM_SAMPLE_RATE - 1) / SIM_NS_PER_SEC;
+	m->asc.nextSampleNs = SampleTimeNs(due + 1);
+	if (m->asc.mode != 1)
+	{
+		m->asc.samplesPlayed = due;
+		return;
+	}
+
+	while (m->asc.samplesPlayed < due)
+	{
+		uint64_t step = SamplesUntilChange(m);
+		if (step > due - m->asc.samplesPlayed)
+		{
+			step = due - m->asc.samplesPlayed;
+		}
+
+		DrainFIFO(m, 0, step);
+		if (IsStereo(m))
+		{
+			DrainFIFO(m, 1, step);
+		}
+		m->asc.samplesPlayed += step;
+		SimVIA2UpdateASCLine(m, SampleTimeNs(m->asc.samplesPlayed));
+	}
+}
+
+// Virtual time of the next sample period that changes a FIFO's status bits
+uint64_t SimASCNextEventNs(const SimMachine *m)
+{
+	if (m->asc.mode != 1)
+	{
+		return SIM_NO_EVENT;
+	}
+
+	const uint64_t samples = SamplesUntilChange(m);
+	return (samples == UINT64_MAX) ? SIM_NO_EVENT : SampleTimeNs(m->asc.samplesPlayed + samples);
+}
+
+// Value an ASC register would read as, without any side effects of reading it
+uint8_t SimASCPeek(const SimMachine *m, uint16_t offset)
+{
+	const SimASCVariant *p = m->profile->ascVariant;
+
+	switch (offset)
+	{
+	case 0x800:
+		return p->version;
+	case 0x801:
+		return m->asc.mode;
+	case 0x802:
+		return m->asc.control;
+	case 0x803:
+		return m->asc.fifoMode;
+	case 0x804:
+		return Status(m);
+	case 0xF09:
+		return p->hasF09 ? m->asc.f09 : 0;
+	case 0xF29:
+		return p->hasF29 ? m->asc.f29 : 0;
+	default:
+		if (offset > 0x804 && offset < 0x900)
+		{
+			return m->asc.regs[offset - 0x800];
+		}
+		return 0;
+	}
+}
+
+// Reads an ASC register
+uint8_t SimASCRead(SimMachine *m, uint16_t offset)
+{
+	const uint8_t value = SimASCPeek(m, offset);
+	if (offset == 0x804)
+	{
+		// Reading the status clears any latched bits, which may drop the IRQ line
+		m->asc.latchedStatus = 0;
+		SimVIA2UpdateASCLine(m, m->timeNs);
+	}
+	return value;
+}
+
+// Bits of a register read that the model knows to match real hardware. Anything
+// else (such as registers that don't exist on this variant) may read differently.
+uint8_t SimASCModeledBits(const SimMachine *m, uint16_t offset)
+{
+	const SimASCVariant *p = m->profile->ascVariant;
+
+	switch (offset)
+	{
+	case 0x800:
+	case 0x801:
+	case 0x804:
+		return 0xFF;
+	case 0x802:
+		return 0x02;
+	case 0xF09:
+		return p->hasF09 ? 0xFF : 0x00;
+	case 0xF29:
+		return p->hasF29 ? 0xFF : 0x00;
+	default:
+		return 0x00;
+	}
+}
+
+// Writes an ASC register
+void SimASCWrite(SimMachine *m, uint16_t offset, uint8_t value)
+{
+	const SimASCVariant *p = m->profile->ascVariant;
+
+	if (offset < 0x800)
+	{
+		// FIFO A lives at $000-$3FF, FIFO B at $400-$7FF
+		if (m->asc.mode == 1)
+		{
+			QueueSample(m, (offset >> 10) & 1, value);
+		}
+	}
+	else switch (offset)
+	{
+	case 0x800:
+	case 0x804:
+		// Read-only
+		break;
+	case 0x801:
+		if (value <= 2 && (p->modesAccepted & (1 << value)))
+		{
+			m->asc.mode = value;
+		}
+		break;
+	case 0x802:
+		if (p->stereoBitWritable)
+		{
+			m->asc.control = value;
+		}
+		else
+		{
+			m->asc.control = (value & ~0x02) | (m->asc.control & 0x02);
+		}
+		break;
+	case 0x803:
+		m->asc.fifoMode = value;
+		if (value & 0x80)
+		{
+			ClearFIFOs(m);
+		}
+		break;
+	case 0xF09:
+		if (p->hasF09)
+		{
+			m->asc.f09 = value;
+		}
+		break;
+	case 0xF29:
+		if (p->hasF29)
+		{
+			m->asc.f29 = value;
+		}
+		break;
+	default:
+		if (offset > 0x804 && offset < 0x900)
+		{
+			m->asc.regs[offset - 0x800] = value;
+		}
+		break;
+	}
+
+	SimVIA2UpdateASCLine(m, m->timeNs);
+}
+
+// Level of the ASC's IRQ output
+bool SimASCIRQLine(const SimMachine *m)
+{
+	const SimASCVariant *p = m->profile->ascVariant;
+	if (m->asc.mode == 0)
+	{
+		return false;
+	}
+	if (p->hasF29 && m->asc.f29 != 0)
+	{
+		return false;
+	}
+	return (Status(m) & p->irqStatusMask) != 0;
+}
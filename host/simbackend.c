@@ -0,0 +1,190 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sim.h"
+
+// Implementation of the asctester.h backend interface on top of the simulated machine.
+// Every access costs the profile's virtual CPU time and gives a pending IRQ a chance to run.
+
+// Each thread talks to its own machine
+static thread_local SimMachine *current;
+
+void SimSetCurrent(SimMachine *m)
+{
+	current = m;
+}
+
+SimMachine *SimCurrent(void)
+{
+	return current;
+}
+
+// Records an access in this thread's trace, if it has one
+static void Trace(uint16_t offset, uint8_t value, uint8_t flags)
+{
+	TraceBuffer *t = traceBuffer;
+	if (t)
+	{
+		const uint8_t ipl = (current->sr >> 8) & 7;
+		TraceStore(t, (uint32_t)(current->timeNs / t->timeUnitNs), offset, value,
+				(ipl != 0 && ipl != 7) ? (flags | TraceIRQ) : flags);
+	}
+}
+
+uint8_t ascReadReg(uint16_t offset)
+{
+	SimAdvance(current, current->profile->readNs);
+	const uint8_t value = SimASCRead(current, offset);
+	Trace(offset, value, 0);
+	SimCheckIRQ(current);
+	return value;
+}
+
+void ascWriteReg(uint16_t offset, uint8_t value)
+{
+	SimAdvance(current, current->profile->writeNs);
+	SimASCWrite(current, offset, value);
+	Trace(offset, value, TraceWrite);
+	SimCheckIRQ(current);
+}
+
+// The ASC takes a byte at a time, so a wider write is broken up into byte writes to
+// consecutive addresses, each taking as long as any other write
+static void WriteBytes(uint16_t offset, uint32_t value, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+	{
+		const uint8_t byte = (uint8_t)(value >> ((bytes - 1 - i) * 8));
+		SimAdvance(current, current->profile->writeNs);
+		SimASCWrite(current, offset + i, byte);
+		Trace(offset + i, byte, TraceWrite);
+	}
+	SimCheckIRQ(current);
+}
+
+void ascWriteWord(uint16_t offset, uint16_t value)
+{
+	WriteBytes(offset, value, 2);
+}
+
+void ascWriteLong(uint16_t offset, uint32_t value)
+{
+	WriteBytes(offset, value, 4);
+}
+
+uint8_t via2ReadReg(uint16_t offset)
+{
+	SimAdvance(current, current->profile->readNs);
+	const uint8_t value = SimVIA2Read(current, offset);
+	Trace(offset, value, TraceVIA2);
+	SimCheckIRQ(current);
+	return value;
+}
+
+void via2WriteReg(uint16_t offset, uint8_t value)
+{
+	SimAdvance(current, current->profile->writeNs);
+	SimVIA2Write(current, offset, value);
+	Trace(offset, value, TraceVIA2 | TraceWrite);
+	SimCheckIRQ(current);
+}
+
+uint32_t via2ReadLong(uint16_t offset)
+{
+	SimAdvance(current, current->profile->readNs);
+	uint32_t value = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		const uint8_t byte = SimVIA2Read(current, offset + i);
+		Trace(offset + i, byte, TraceVIA2);
+		value = (value << 8) | byte;
+	}
+	SimCheckIRQ(current);
+	return value;
+}
+
+uint8_t via1ReadReg(uint16_t offset)
+{
+	SimAdvance(current, current->profile->readNs);
+	const uint8_t value = SimVIA1Read(current, offset);
+	SimCheckIRQ(current);
+	return value;
+}
+
+volatile VIA2Handler *via2Handlers(void)
+{
+	return current->via2Handlers;
+}
+
+uint32_t ticks(void)
+{
+	SimAdvance(current, current->profile->pollNs);
+	SimCheckIRQ(current);
+	current->pollsSinceTicks = 0;
+	return (uint32_t)(current->timeNs / SIM_TICK_NS);
+}
+
+uint32_t currentTicks(void)
+{
+	return (uint32_t)(current->timeNs / SIM_TICK_NS);
+}
+
+// A wait starts with ticks() and then polls this. The first poll lets the loop body
+// look at the current state; later polls skip straight to the next event.
+bool ticksElapsed(uint32_t startTicks, uint32_t count)
+{
+	if (current->pollsSinceTicks++ == 0)
+	{
+		SimAdvance(current, current->profile->pollNs);
+		SimCheckIRQ(current);
+	}
+	else
+	{
+		SimFastForward(current, (uint64_t)(startTicks + count) * SIM_TICK_NS);
+	}
+	return (uint32_t)(current->timeNs / SIM_TICK_NS) - startTicks >= count;
+}
+
+void waitTicks(uint32_t count)
+{
+	const uint32_t startTicks = ticks();
+	while (!ticksElapsed(startTicks, count))
+	{
+	}
+}
+
+uint32_t addrMapFlags(void)
+{
+	return current->profile->addrMapFlags;
+}
+
+uint8_t boxFlag(void)
+{
+	return current->profile->boxFlag;
+}
+
+void **applScratch(void)
+{
+	return &current->applScratch;
+}
+
+uint16_t DisableIRQ(void)
+{
+	const uint16_t sr = current->sr;
+	current->sr |= 0x0700;
+	return sr;
+}
+
+void RestoreIRQ(uint16_t sr)
+{
+	// The move to SR takes about as long as a register write
+	SimAdvance(current, current->profile->writeNs);
+	current->sr = sr;
+	SimCheckIRQ(current);
+}
+
+void nop(void)
+{
+	SimAdvance(current, current->profile->writeNs / 4);
+	SimCheckIRQ(current);
+}
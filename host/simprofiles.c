@@ -0,0 +1,218 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "sim.h"
+
+// ASC variants, keyed by the value of register $800
+
+// Original ASC: stereo is optional, status bits latch and clear on read, and the
+// full/empty bit never reports empty
+static const SimASCVariant ascVariant00 =
+{
+	.version = 0x00, .modesAccepted = 0x07, .initialMode = 0,
+	.stereoBitWritable = true, .alwaysStereo = false,
+	.hasF09 = false, .hasF29 = false, .initialF09 = 0, .initialF29 = 0,
+	.statusType = SimStatusLatched, .statusForceOn = 0x00, .statusForceOff = 0x00,
+	.irqStatusMask = 0x0F, .fullLevel = SIM_FIFO_SIZE,
+};
+
+// Mono-only variants in the LC family: only FIFO A, and the IRQ follows its
+// half empty bit, so it floods while idle
+static const SimASCVariant ascVariantE0 =
+{
+	.version = 0xE0, .modesAccepted = 0x02, .initialMode = 1,
+	.stereoBitWritable = false, .alwaysStereo = false,
+	.hasF09 = false, .hasF29 = false, .initialF09 = 0, .initialF29 = 0,
+	.statusType = SimStatusLevel, .statusForceOn = 0x00, .statusForceOff = 0x0C,
+	.irqStatusMask = 0x01, .fullLevel = SIM_FIFO_SIZE,
+};
+
+static const SimASCVariant ascVariantE8 =
+{
+	.version = 0xE8, .modesAccepted = 0x02, .initialMode = 1,
+	.stereoBitWritable = false, .alwaysStereo = false,
+	.hasF09 = false, .hasF29 = false, .initialF09 = 0, .initialF29 = 0,
+	.statusType = SimStatusLevel, .statusForceOn = 0x00, .statusForceOff = 0x0C,
+	.irqStatusMask = 0x01, .fullLevel = SIM_FIFO_SIZE,
+};
+
+// Same as $E8, but the full flag turns on a little before the FIFO is completely full
+static const SimASCVariant ascVariantE9 =
+{
+	.version = 0xE9, .modesAccepted = 0x02, .initialMode = 1,
+	.stereoBitWritable = false, .alwaysStereo = false,
+	.hasF09 = false, .hasF29 = false, .initialF09 = 0, .initialF29 = 0,
+	.statusType = SimStatusLevel, .statusForceOn = 0x00, .statusForceOff = 0x0C,
+	.irqStatusMask = 0x01, .fullLevel = SIM_FIFO_SIZE - 32,
+};
+
+// Always-stereo variants with $F09/$F29: the IRQ follows FIFO B's half empty bit
+// and is gated by $F29
+static const SimASCVariant ascVariantB0 =
+{
+	.version = 0xB0, .modesAccepted = 0x03, .initialMode = 1,
+	.stereoBitWritable = false, .alwaysStereo = true,
+	.hasF09 = true, .hasF29 = true, .initialF09 = 1, .initialF29 = 1,
+	.statusType = SimStatusLevel, .statusForceOn = 0x00, .statusForceOff = 0x00,
+	.irqStatusMask = 0x04, .fullLevel = SIM_FIFO_SIZE,
+};
+
+// Like $B0, but FIFO A's status bits are stuck (half empty off, full/empty on)
+static const SimASCVariant ascVariantBB =
+{
+	.version = 0xBB, .modesAccepted = 0x03, .initialMode = 1,
+	.stereoBitWritable = false, .alwaysStereo = true,
+	.hasF09 = true, .hasF29 = true, .initialF09 = 1, .initialF29 = 1,
+	.statusType = SimStatusLevel, .statusForceOn = 0x02, .statusForceOff = 0x01,
+	.irqStatusMask = 0x04, .fullLevel = SIM_FIFO_SIZE,
+};
+
+// Like $BB, but mode 0 can't be selected
+static const SimASCVariant ascVariantBC =
+{
+	.version = 0xBC, .modesAccepted = 0x02, .initialMode = 1,
+	.stereoBitWritable = false, .alwaysStereo = true,
+	.hasF09 = true, .hasF29 = true, .initialF09 = 1, .initialF29 = 1,
+	.statusType = SimStatusLevel, .statusForceOn = 0x02, .statusForceOff = 0x01,
+	.irqStatusMask = 0x04, .fullLevel = SIM_FIFO_SIZE,
+};
+
+// Machines. The first group reproduces the README's test version 3 results. The
+// second group only has older results to go by, so the System version and
+// AddrMapFlags are typical values for that kind of machine, and the CPU timing is
+// borrowed from a similar machine.
+const SimProfile simProfiles[] =
+{
+	{
+		.name = "iici", .description = "Mac IIci", .boxFlag = 5, .ascVariant = &ascVariant00,
+		.sysVersion = 0x0710, .addrMapFlags = 0x0000773F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x0013, .via2IRQType = SimVIA2IRQEdge,
+		.readNs = 4300, .writeNs = 250, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 20000,
+	},
+	{
+		.name = "lc", .description = "LC", .boxFlag = 13, .ascVariant = &ascVariantE8,
+		.sysVersion = 0x0710, .addrMapFlags = 0x0000773F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x0013, .via2IRQType = SimVIA2IRQLevel,
+		.readNs = 8081, .writeNs = 500, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 31426,
+	},
+	{
+		.name = "lc3", .description = "LC III", .boxFlag = 21, .ascVariant = &ascVariantBC,
+		.sysVersion = 0x0710, .addrMapFlags = 0x0000773F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x001F, .via2IRQType = SimVIA2IRQLevel,
+		.readNs = 4358, .writeNs = 250, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 12395,
+	},
+	{
+		.name = "lc475", .description = "LC 475", .boxFlag = 83, .ascVariant = &ascVariantBB,
+		.sysVersion = 0x0753, .addrMapFlags = 0x0500183F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x0000, .via2IRQType = SimVIA2IRQEdge,
+		.readNs = 3718, .writeNs = 250, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 10000,
+	},
+	{
+		.name = "q700", .description = "Quadra 700", .boxFlag = 16, .ascVariant = &ascVariantB0,
+		.sysVersion = 0x0761, .addrMapFlags = 0x05A0183F, .hasASCVBLTask = true,
+		.via2DecodeMask = 0x0000, .via2IRQType = SimVIA2IRQEdge,
+		.readNs = 3532, .writeNs = 250, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 10000,
+	},
+	{
+		.name = "duo210", .description = "PowerBook Duo 210", .boxFlag = 23, .ascVariant = &ascVariantE9,
+		.sysVersion = 0x0711, .addrMapFlags = 0x0000773F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x00FF, .via2IRQType = SimVIA2IRQLevel,
+		.readNs = 1381, .writeNs = 250, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 16966,
+	},
+
+	{
+		.name = "q950", .description = "Quadra 950", .boxFlag = 20, .ascVariant = &ascVariantB0,
+		.sysVersion = 0x0710, .addrMapFlags = 0x05A0183F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x0000, .via2IRQType = SimVIA2IRQEdge,
+		.readNs = 3532, .writeNs = 250, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 10000,
+	},
+	{
+		.name = "q800", .description = "Quadra 800", .boxFlag = 29, .ascVariant = &ascVariantBB,
+		.sysVersion = 0x0710, .addrMapFlags = 0x0500183F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x0000, .via2IRQType = SimVIA2IRQEdge,
+		.readNs = 3718, .writeNs = 250, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 10000,
+	},
+	{
+		.name = "pb180", .description = "PowerBook 180", .boxFlag = 27, .ascVariant = &ascVariantB0,
+		.sysVersion = 0x0710, .addrMapFlags = 0x0500183F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x0000, .via2IRQType = SimVIA2IRQEdge,
+		.readNs = 3532, .writeNs = 250, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 10000,
+	},
+	{
+		.name = "duo280c", .description = "PowerBook Duo 280c", .boxFlag = 97, .ascVariant = &ascVariantE9,
+		.sysVersion = 0x0711, .addrMapFlags = 0x0000773F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x01FF, .via2IRQType = SimVIA2IRQLevel,
+		.readNs = 1381, .writeNs = 250, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 3389,
+	},
+	{
+		.name = "pb520", .description = "PowerBook 520c/540c", .boxFlag = 66, .ascVariant = &ascVariantBB,
+		.sysVersion = 0x0751, .addrMapFlags = 0x0500183F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x0000, .via2IRQType = SimVIA2IRQLevel,
+		.readNs = 3718, .writeNs = 250, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 1661,
+	},
+	{
+		.name = "classic2", .description = "Classic II", .boxFlag = 17, .ascVariant = &ascVariantE0,
+		.sysVersion = 0x0710, .addrMapFlags = 0x0000773F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x0013, .via2IRQType = SimVIA2IRQLevel,
+		.readNs = 8081, .writeNs = 500, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 31426,
+	},
+	{
+		.name = "lc2", .description = "LC II", .boxFlag = 31, .ascVariant = &ascVariantE8,
+		.sysVersion = 0x0710, .addrMapFlags = 0x0000773F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x0013, .via2IRQType = SimVIA2IRQLevel,
+		.readNs = 8081, .writeNs = 500, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 31426,
+	},
+	{
+		.name = "lc550", .description = "LC 550", .boxFlag = 74, .ascVariant = &ascVariantBC,
+		.sysVersion = 0x0710, .addrMapFlags = 0x0000773F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x001F, .via2IRQType = SimVIA2IRQLevel,
+		.readNs = 4358, .writeNs = 250, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 12395,
+	},
+	{
+		.name = "colorclassic", .description = "Color Classic", .boxFlag = 43, .ascVariant = &ascVariantE8,
+		.sysVersion = 0x0710, .addrMapFlags = 0x0000773F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x001F, .via2IRQType = SimVIA2IRQLevel,
+		.readNs = 8081, .writeNs = 500, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 31426,
+	},
+	{
+		.name = "centris610", .description = "Centris 610", .boxFlag = 46, .ascVariant = &ascVariantBB,
+		.sysVersion = 0x0710, .addrMapFlags = 0x0500183F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x0000, .via2IRQType = SimVIA2IRQEdge,
+		.readNs = 3718, .writeNs = 250, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 10000,
+	},
+	{
+		.name = "lc630", .description = "LC 630", .boxFlag = 92, .ascVariant = &ascVariantBB,
+		.sysVersion = 0x0753, .addrMapFlags = 0x0500183F, .hasASCVBLTask = false,
+		.via2DecodeMask = 0x0000, .via2IRQType = SimVIA2IRQEdge,
+		.readNs = 3718, .writeNs = 250, .pollNs = 2000, .irqLatencyNs = 100, .irqEntryNs = 10000,
+	},
+};
+
+const size_t simProfileCount = sizeof(simProfiles) / sizeof(simProfiles[0]);
+
+// Looks up a profile by its short name
+const SimProfile *SimFindProfile(const char *name)
+{
+	for (size_t i = 0; i < simProfileCount; i++)
+	{
+		if (!strcmp(simProfiles[i].name, name))
+		{
+			return &simProfiles[i];
+		}
+	}
+	return NULL;
+}
+
+// Looks up a profile by BoxFlag and ASC version
+const SimProfile *SimFindProfileByID(uint8_t boxFlag, uint8_t ascVersion)
+{
+	for (size_t i = 0; i < simProfileCount; i++)
+	{
+		if (simProfiles[i].boxFlag == boxFlag && simProfiles[i].ascVariant->version == ascVersion)
+		{
+			return &simProfiles[i];
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,136 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sim.h"
+#include "tracefile.h"
+
+// Replays a captured trace through the model. Writes are applied as they happened,
+// and every read the model covers is checked against what the hardware returned.
+// The trace already holds the accesses the IRQ handlers made, so the model never
+// calls a handler itself; it only checks that it was asking for the interrupt.
+//
+// Trace times count from when the machine started, which is also when the model's
+// clock starts, so the FIFOs drain in step with the trace. Times can be coarse (Ticks
+// on real hardware), so the model keeps its own clock: each access costs what the
+// profile says, but the clock never falls behind the start of the event's time unit.
+// When the model disagrees, it gets one more chance at any time up to the end of that
+// unit, in case the hardware was simply further along.
+
+// Latest virtual time the event could have happened at
+static uint64_t LatestTimeNs(const TraceFile *tf, const TraceEvent *e)
+{
+	return ((uint64_t)e->time + 1) * tf->timeUnitNs - 1;
+}
+
+// Moves the model's clock forward through its status changes, up to limitNs, until
+// check() is happy
+static bool CatchUpUntil(SimMachine *m, uint64_t limitNs, bool (*check)(SimMachine *, const TraceEvent *),
+		const TraceEvent *e)
+{
+	while (!check(m, e))
+	{
+		const uint64_t next = SimASCNextEventNs(m);
+		if (next == SIM_NO_EVENT || next > limitNs || next <= m->timeNs)
+		{
+			return false;
+		}
+		SimAdvance(m, next - m->timeNs);
+	}
+	return true;
+}
+
+static bool IRQPending(SimMachine *m, const TraceEvent *e)
+{
+	return SimVIA2IRQPending(m);
+}
+
+static uint8_t ComparedBits(const SimMachine *m, const TraceEvent *e)
+{
+	return (e->flags & TraceVIA2) ? SimVIA2ModeledBits(m, e->address) : SimASCModeledBits(m, e->address);
+}
+
+static uint8_t ModelValue(SimMachine *m, const TraceEvent *e)
+{
+	return (e->flags & TraceVIA2) ? SimVIA2Read(m, e->address) : SimASCPeek(m, e->address);
+}
+
+static bool ReadMatches(SimMachine *m, const TraceEvent *e)
+{
+	return !((ModelValue(m, e) ^ e->value) & ComparedBits(m, e));
+}
+
+void SimReplay(SimMachine *m, const TraceFile *tf, SimReplayResult *result)
+{
+	const SimProfile *p = m->profile;
+	TraceEvent e;
+	bool inIRQ = false;
+
+	memset(result, 0, sizeof(*result));
+
+	for (uint32_t i = 0; i < tf->count; i++)
+	{
+		TraceFileEvent(tf, i, &e);
+		result->events = i + 1;
+
+		// Spend the access's time, but don't fall behind the trace
+		uint64_t targetNs = m->timeNs + ((e.flags & TraceWrite) ? p->writeNs : p->readNs);
+		const bool enteringIRQ = (e.flags & TraceIRQ) && !inIRQ;
+		if (enteringIRQ)
+		{
+			targetNs += p->irqEntryNs;
+		}
+		const uint64_t traceNs = (uint64_t)e.time * tf->timeUnitNs;
+		if (targetNs < traceNs)
+		{
+			targetNs = traceNs;
+		}
+		SimAdvance(m, targetNs - m->timeNs);
+		inIRQ = e.flags & TraceIRQ;
+
+		// The hardware took an interrupt here, so the model should be asking for one
+		if (enteringIRQ && !CatchUpUntil(m, LatestTimeNs(tf, &e), IRQPending, &e))
+		{
+			result->diverged = true;
+			result->divergedAt = i;
+			result->reason = "the hardware took an interrupt that the model wasn't requesting";
+			return;
+		}
+
+		if (e.flags & TraceWrite)
+		{
+			if (e.flags & TraceVIA2)
+			{
+				SimVIA2Write(m, e.address, e.value);
+			}
+			else
+			{
+				SimASCWrite(m, e.address, e.value);
+			}
+			continue;
+		}
+
+		if (ComparedBits(m, &e))
+		{
+			result->readsCompared++;
+			if (!CatchUpUntil(m, LatestTimeNs(tf, &e), ReadMatches, &e))
+			{
+				result->diverged = true;
+				result->divergedAt = i;
+				result->modelValue = ModelValue(m, &e);
+				result->comparedBits = ComparedBits(m, &e);
+				result->reason = "the model read a different value";
+				return;
+			}
+		}
+
+		// Now do the real read, for its side effects
+		if (e.flags & TraceVIA2)
+		{
+			(void)SimVIA2Read(m, e.address);
+		}
+		else
+		{
+			(void)SimASCRead(m, e.address);
+		}
+	}
+}
@@ -0,0 +1,29 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <Gestalt.h>
+#include "sim.h"
+
+// Toolbox calls made by tests.c, answered on behalf of the simulated machine
+
+OSErr Gestalt(OSType selector, long *response)
+{
+	if (selector == gestaltSystemVersion)
+	{
+		*response = SimCurrent()->profile->sysVersion;
+		return noErr;
+	}
+	return gestaltUndefSelectorErr;
+}
+
+QHdr LMGetVBLQueue(void)
+{
+	SimMachine *m = SimCurrent();
+	QHdr queue = {0, NULL, NULL};
+	if (m->profile->hasASCVBLTask)
+	{
+		queue.qHead = (QElemPtr)&m->ascVBLTask;
+		queue.qTail = queue.qHead;
+	}
+	return queue;
+}
@@ -0,0 +1,57 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "sim.h"
+
+// VIA1, as far as the timing code sees it: two timers counting down at the VIA clock
+// and the registers that say whether they're in use. The counters follow the virtual
+// clock, so they need no state of their own. Timer 2's interrupt is enabled, as if
+// the OS were using it, so the timing code has to pick timer 1.
+
+// VIA1 registers, numbered the way the VIA decodes them (one every $200 bytes)
+enum SimVIA1Register
+{
+	VIA1RegT1CL = 4,
+	VIA1RegT1CH = 5,
+	VIA1RegT1LL = 6,
+	VIA1RegT1LH = 7,
+	VIA1RegT2CL = 8,
+	VIA1RegT2CH = 9,
+	VIA1RegACR = 11,
+	VIA1RegIER = 14
+};
+
+// Timer 2 is started half a period away from timer 1, so the two can't be mixed up
+#define SIM_VIA1_T2_PHASE			0x8000
+
+// VIA clock counts since the machine started
+static uint16_t Counts(const SimMachine *m)
+{
+	return (uint16_t)(m->timeNs * SIM_VIA_CLOCK / SIM_NS_PER_SEC);
+}
+
+uint8_t SimVIA1Read(const SimMachine *m, uint16_t offset)
+{
+	const uint16_t t1 = 0xFFFF - Counts(m);
+	const uint16_t t2 = SIM_VIA1_T2_PHASE - Counts(m);
+
+	switch ((offset >> 9) & 0x0F)
+	{
+	case VIA1RegT1CL:
+		return t1 & 0xFF;
+	case VIA1RegT1CH:
+		return t1 >> 8;
+	case VIA1RegT1LL:
+	case VIA1RegT1LH:
+		return 0xFF;
+	case VIA1RegT2CL:
+		return t2 & 0xFF;
+	case VIA1RegT2CH:
+		return t2 >> 8;
+	case VIA1RegACR:
+		return 0x00;
+	case VIA1RegIER:
+		return 0x80 | 0x20;
+	default:
+		return 0x00;
+	}
+}
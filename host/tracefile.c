@@ -0,0 +1,163 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tracefile.h"
+
+// Header size of version 1 files, which had no index
+#define TRACE_V1_HEADER_SIZE		24
+
+static uint16_t Read16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static uint32_t Read32(const uint8_t *p)
+{
+	return ((uint32_t)Read16(p) << 16) | Read16(p + 2);
+}
+
+// Maps a trace file and checks its header. Prints what's wrong if it can't be used.
+bool TraceFileOpen(TraceFile *tf, const char *path)
+{
+	memset(tf, 0, sizeof(*tf));
+	const int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0)
+	{
+		perror(path);
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+		return false;
+	}
+
+	tf->size = st.st_size;
+	void *data = (tf->size > 0) ? mmap(NULL, tf->size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		fprintf(stderr, "%s: can't map the file\n", path);
+		return false;
+	}
+	tf->data = (const uint8_t *)data;
+
+	if (tf->size < TRACE_V1_HEADER_SIZE || memcmp(tf->data, "ASCTrace", 8))
+	{
+		fprintf(stderr, "%s: not a trace file\n", path);
+		TraceFileClose(tf);
+		return false;
+	}
+
+	tf->version = Read16(tf->data + 8);
+	tf->timeUnitNs = Read32(tf->data + 12);
+	tf->count = Read32(tf->data + 16);
+	tf->dropped = Read32(tf->data + 20);
+	size_t headerSize = TRACE_V1_HEADER_SIZE;
+	if (tf->version >= 2)
+	{
+		headerSize = TRACE_HEADER_SIZE;
+		tf->indexInterval = (tf->size >= TRACE_HEADER_SIZE) ? Read32(tf->data + 24) : 0;
+	}
+	if (tf->version < 1 || tf->version > TRACE_FILE_VERSION ||
+		tf->size < headerSize + (size_t)tf->count * TRACE_EVENT_SIZE)
+	{
+		fprintf(stderr, "%s: unsupported or truncated trace (version %u)\n", path, tf->version);
+		TraceFileClose(tf);
+		return false;
+	}
+	tf->events = tf->data + headerSize;
+
+	if (tf->indexInterval)
+	{
+		const uint32_t indexOffset = Read32(tf->data + 28);
+		const size_t entries = (tf->count + tf->indexInterval - 1) / tf->indexInterval;
+		if (indexOffset + entries * 4 <= tf->size)
+		{
+			tf->index = tf->data + indexOffset;
+		}
+		else
+		{
+			tf->indexInterval = 0;
+		}
+	}
+	return true;
+}
+
+void TraceFileClose(TraceFile *tf)
+{
+	if (tf->data)
+	{
+		munmap((void *)tf->data, tf->size);
+	}
+	memset(tf, 0, sizeof(*tf));
+}
+
+// Decodes event i
+void TraceFileEvent(const TraceFile *tf, uint32_t i, TraceEvent *e)
+{
+	const uint8_t *p = tf->events + (size_t)i * TRACE_EVENT_SIZE;
+	e->time = Read32(p);
+	e->address = Read16(p + 4);
+	e->value = p[6];
+	e->flags = p[7];
+}
+
+static uint32_t EventTime(const TraceFile *tf, uint32_t i)
+{
+	return Read32(tf->events + (size_t)i * TRACE_EVENT_SIZE);
+}
+
+// Finds the first event at or after the given time (count if there isn't one). The
+// index narrows it down to one block, so only that block's events get touched.
+uint32_t TraceFileFind(const TraceFile *tf, uint32_t time)
+{
+	uint32_t low = 0;
+	uint32_t high = tf->count;
+
+	if (tf->index)
+	{
+		// Last block that starts before the time we want
+		uint32_t blockLow = 0;
+		uint32_t blockHigh = (tf->count + tf->indexInterval - 1) / tf->indexInterval;
+		while (blockLow < blockHigh)
+		{
+			const uint32_t mid = (blockLow + blockHigh) / 2;
+			if (Read32(tf->index + mid * 4) < time)
+			{
+				blockLow = mid + 1;
+			}
+			else
+			{
+				blockHigh = mid;
+			}
+		}
+		if (blockLow > 0)
+		{
+			low = (blockLow - 1) * tf->indexInterval;
+		}
+		if ((uint64_t)blockLow * tf->indexInterval < high)
+		{
+			high = blockLow * tf->indexInterval;
+		}
+	}
+
+	while (low < high)
+	{
+		const uint32_t mid = low + (high - low) / 2;
+		if (EventTime(tf, mid) < time)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	return low;
+}
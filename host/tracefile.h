@@ -0,0 +1,29 @@
+#ifndef TRACEFILE_H
+#define TRACEFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "trace.h"
+
+// Read-only access to a trace file written by TraceWriteFile. The file is mapped
+// into memory rather than read, so only the parts that are looked at get loaded.
+struct TraceFile
+{
+	const uint8_t *data;					// The mapped file
+	size_t size;							// Size of the file in bytes
+	uint16_t version;						// Format version
+	uint32_t timeUnitNs;					// Length of one time unit in nanoseconds
+	uint32_t count;							// Number of events
+	uint32_t dropped;						// Events that didn't fit in the capture buffer
+	uint32_t indexInterval;					// Events per index entry (0 if there's no index)
+	const uint8_t *events;					// First event
+	const uint8_t *index;					// First index entry (NULL if there's no index)
+};
+
+bool TraceFileOpen(TraceFile *tf, const char *path);
+void TraceFileClose(TraceFile *tf);
+void TraceFileEvent(const TraceFile *tf, uint32_t i, TraceEvent *e);
+uint32_t TraceFileFind(const TraceFile *tf, uint32_t time);
+
+#endif
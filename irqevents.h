@@ -0,0 +1,93 @@
+#ifndef IRQEVENTS_H
+#define IRQEVENTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Queue of events recorded by an IRQ handler for the main program to go through.
+// Only the handler adds events and only the main program takes them, so each index
+// is written by one side only and nothing needs to be locked; with a single CPU, all
+// that matters is that the compiler doesn't reorder the accesses. If the main program
+// falls behind and the queue fills up, further events are only counted.
+
+// Number of events the queue holds (a power of 2)
+#define IRQ_EVENT_QUEUE_SIZE		1024
+
+// Which handler recorded an event
+enum IRQEventHandler
+{
+	IRQEventFIFOAHandler,					// FIFO IRQ handler looking at the FIFO A status bits
+	IRQEventFIFOBHandler					// FIFO IRQ handler looking at the FIFO B status bits
+};
+
+// One IRQ
+struct IRQEvent
+{
+	uint32_t timeUs;						// TimingNow() when the handler ran
+	uint8_t status;							// Register $804 as the handler read it
+	uint8_t handler;						// Which handler it was (an IRQEventHandler)
+};
+
+// The queue. The indexes count up forever and wrap around; only their difference matters.
+struct IRQEventQueue
+{
+	IRQEvent events[IRQ_EVENT_QUEUE_SIZE];
+	volatile uint16_t head;					// Events added so far (only written by the handler)
+	volatile uint16_t tail;					// Events taken so far (only written by the main program)
+	volatile uint32_t dropped;				// Events that didn't fit (only written by the handler)
+};
+
+// Keeps the compiler from moving memory accesses from one side of this to the other
+static inline void IRQEventBarrier(void)
+{
+	__asm__ volatile ( "" : : : "memory" );
+}
+
+// Empties the queue. Only call this while the handler can't run.
+static inline void IRQEventQueueReset(IRQEventQueue *q)
+{
+	q->head = 0;
+	q->tail = 0;
+	q->dropped = 0;
+}
+
+// Adds an event to the queue. Only the handler calls this.
+static inline void IRQEventPush(IRQEventQueue *q, uint32_t timeUs, uint8_t status, uint8_t handler)
+{
+	const uint16_t head = q->head;
+	if ((uint16_t)(head - q->tail) >= IRQ_EVENT_QUEUE_SIZE)
+	{
+		q->dropped++;
+		return;
+	}
+
+	IRQEvent *e = &q->events[head & (IRQ_EVENT_QUEUE_SIZE - 1)];
+	e->timeUs = timeUs;
+	e->status = status;
+	e->handler = handler;
+
+	// The event has to be complete before the main program can see it
+	IRQEventBarrier();
+	q->head = head + 1;
+}
+
+// Takes the oldest event from the queue, returning false if it's empty. Only the
+// main program calls this.
+static inline bool IRQEventPop(IRQEventQueue *q, IRQEvent *e)
+{
+	const uint16_t tail = q->tail;
+	if (tail == q->head)
+	{
+		return false;
+	}
+
+	IRQEventBarrier();
+	*e = q->events[tail & (IRQ_EVENT_QUEUE_SIZE - 1)];
+
+	// The event has to be copied before the handler can reuse its slot
+	IRQEventBarrier();
+	q->tail = tail + 1;
+	return true;
+}
+
+#endif
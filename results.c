@@ -0,0 +1,715 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Gestalt.h>
+#include "tests.h"
+#include "timing.h"
+
+// Everything about reporting TestResults: the human readable report, and the
+// machine-readable record saved alongside it.
+
+// Whether a machine with these AddrMapFlags has the hardware the tests need
+bool CanTestMachine(uint32_t addrMapFlags)
+{
+	const bool via2Exists = addrMapFlags & (1U << 11);
+	const bool ascExists = addrMapFlags & (1U << 12);
+	const bool rbvExists = addrMapFlags & (1U << 13);
+	return ascExists && (via2Exists || rbvExists);
+}
+
+// Prints info about a FIFO test (stereo or mono)
+static void PrintFIFOTests(const char *title, struct FIFOTestResults const *f)
+{
+	printf("%s:\n", title);
+	printf("%d %d %d %d %d %d %d %d %d %d %d %d (%u %u)\n",
+			f->aFullTooSoon, f->bFullTooSoon,
+			f->aReachesFull, f->bReachesFull,
+			f->aHalfEmptyIsOffWhenFull, f->bHalfEmptyIsOffWhenFull,
+			f->aHalfEmptyTurnsOn, f->bHalfEmptyTurnsOn,
+			f->aEmptyIsOffWhenHalfEmpty, f->bEmptyIsOffWhenHalfEmpty,
+			f->aReachesEmpty, f->bReachesEmpty,
+			f->aFullCount, f->bFullCount);
+}
+
+// Prints the results of DoTests
+void PrintResults(const TestResults *r)
+{
+	const uint32_t flags = r->addrMapFlags;
+	const bool via2Exists = flags & (1U << 11);
+	const bool ascExists = flags & (1U << 12);
+	const bool rbvExists = flags & (1U << 13);
+
+	printf("ASCTester test version %d\n", TEST_VERSION);
+
+	if (CanTestMachine(flags))
+	{
+		printf("BoxFlag: %d   ASC Version: $%02X   System %d.%d.%d\n", r->boxFlag, r->ascVersion,
+				(int)((r->sysVersion >> 8) & 0xFF), (int)((r->sysVersion >> 4) & 0x0F),
+				(int)(r->sysVersion & 0x0F));
+		printf("AddrMapFlags: $%08X\n", flags);
+		printf("F09: %d ($%02X)  F29: %d ($%02X)\n",
+				r->regF09Exists, r->regF09InitialValue,
+				r->regF29Exists, r->regF29InitialValue);
+		printf("804Idle: $%02X  M0: %d M1: %d M2: %d ($%02X)\n",
+				r->reg804IdleValue, r->acceptsMode0, r->acceptsMode1, r->acceptsMode2, r->reg801InitialValue);
+		printf("Mono: %d %d Stereo: %d %d\n", r->acceptsConfigMono, r->shouldTestMono,
+				r->acceptsConfigStereo, r->shouldTestStereo);
+
+		if (r->shouldTestMono)
+		{
+			PrintFIFOTests("Mono FIFO Tests", &r->monoFIFO);
+		}
+		if (r->shouldTestStereo)
+		{
+			PrintFIFOTests("Stereo FIFO Tests", &r->stereoFIFO);
+		}
+		printf("VIA2 (%d $%04X) %d\n", r->via2ReadbackConsistent, r->via2AddressDecodeMask, r->via2MirroringOK);
+		printf("Idle IRQ %d %d %d (%u), %d %d %d (%u), %d %d %d\n",
+				r->idleIRQWithoutF29, r->floodsIRQWithoutF29, r->irqFloodWithoutF29TakesOverCPU,
+				r->idleIRQWithoutF29Count,
+				r->idleIRQWithF29, r->floodsIRQWithF29, r->irqFloodWithF29TakesOverCPU,
+				r->idleIRQWithF29Count,
+				r->refiresIdleIRQWithF29, r->refiresIdleIRQFloodWithF29, r->irqFloodRefireWithF29TakesOverCPU);
+		printf("FIFO IRQ %d %d %d %d\n", r->testedFIFOIRQs, r->fifoIRQTestedWasA,
+				r->gotIRQOnFIFOHalfEmptyTooSoon, r->gotIRQOnFIFOEmptyTooSoon);
+		printf("(%u %u), (%u %u), (%u %u), (%u %u), %d\n",
+				r->fullIRQCount, r->fullIRQMaxDiff,
+				r->halfEmptyIRQCount, r->halfEmptyIRQMaxDiff,
+				r->emptyIRQCount, r->emptyIRQMaxDiff,
+				r->otherIRQCount, r->otherIRQMaxDiff,
+				r->fifoIRQFiredAfterToggleWhenFull);
+		if (r->ascVBLTaskDisabled)
+		{
+			printf("ASC VBL Task was located and temporarily disabled during this test.\n");
+		}
+	}
+	else
+	{
+		printf("BoxFlag: %d cannot be tested. AddrMapFlags: $%08X\n", r->boxFlag, flags);
+		if (!ascExists)
+		{
+			printf("- ASC address map flag isn't valid\n");
+		}
+		if (!via2Exists && !rbvExists)
+		{
+			printf("- VIA2 and RBV address map flags aren't valid\n");
+		}
+	}
+}
+
+// Converts a number of loop iterations to microseconds, given how long one takes
+static unsigned long IterationsToUs(uint32_t iterations, uint32_t nsPerIteration)
+{
+	return (unsigned long)(((uint64_t)iterations * nsPerIteration + 500) / 1000);
+}
+
+// Prints the time it took to write the samples a FIFO test counted before each FIFO
+// was marked as full
+static void PrintFIFOFillTime(const char *title, struct FIFOTestResults const *f, uint32_t fillNs)
+{
+	printf("%s fill time: (%lu %lu) us\n", title,
+			IterationsToUs(f->aFullCount, fillNs), IterationsToUs(f->bFullCount, fillNs));
+}
+
+// Prints how fast one FIFO played
+static void PrintDrainRate(char fifo, bool stereo, uint32_t fullToHalfUs, uint32_t halfToEmptyUs,
+		uint32_t rateMilliHz, uint32_t jitterUs)
+{
+	printf("FIFO %c drain (%s): full->half %lu us, half->empty %lu us, %lu.%03lu Hz, jitter %lu us\n",
+			fifo, stereo ? "stereo" : "mono", (unsigned long)fullToHalfUs, (unsigned long)halfToEmptyUs,
+			(unsigned long)(rateMilliHz / 1000), (unsigned long)(rateMilliHz % 1000), (unsigned long)jitterUs);
+}
+
+// Prints how fast samples could be written to the FIFOs in one mode
+static void PrintWriteRate(const char *title, struct FIFOWriteRateResults const *w)
+{
+	printf("%s FIFO writes: byte %lu/s, unrolled %lu/s, word %lu/s, long %lu/s\n", title,
+			(unsigned long)w->byteRate, (unsigned long)w->unrolledRate,
+			(unsigned long)w->wordRate, (unsigned long)w->longRate);
+}
+
+// Prints one run of the FIFO IRQ timeline
+static void PrintTimelineRun(struct IRQTimelineRun const *run)
+{
+	static const char *statusNames[] = { "neither", "half empty", "full", "empty" };
+	const char *name = statusNames[run->status & 3];
+
+	if (run->count == 1)
+	{
+		printf("  %s at %lu us\n", name, (unsigned long)run->startUs);
+	}
+	else
+	{
+		printf("  %s at %lu us, burst of %lu over %lu us\n", name, (unsigned long)run->startUs,
+				(unsigned long)run->count, (unsigned long)run->spanUs);
+	}
+}
+
+// Prints the results of streaming in one mode
+static void PrintStreaming(const char *title, struct StreamingResults const *s)
+{
+	printf("%s streaming (FIFO %c bits): smallest chunk without underruns %lu\n", title,
+			s->fifoA ? 'A' : 'B', (unsigned long)s->minChunk);
+	for (int i = 0; i < STREAM_CHUNK_SIZES; i++)
+	{
+		printf("  %3d samples: %lu underruns, %lu IRQs/s, ", 0x200 >> i, (unsigned long)s->underruns[i],
+				(unsigned long)s->irqRate[i]);
+		if (s->refillTimed)
+		{
+			printf("refill %lu us (max %lu us), ", (unsigned long)s->refillAvgUs[i], (unsigned long)s->refillMaxUs[i]);
+		}
+		printf("CPU %lu.%lu%%\n", (unsigned long)(s->cpuPermille[i] / 10), (unsigned long)(s->cpuPermille[i] % 10));
+	}
+}
+
+// Prints how fast the FIFO played with one setting of the clock rate register
+static void PrintSampleRate(int setting, struct SampleRateResults const *s)
+{
+	static const char *nominalRates[RATE_SETTINGS] = { "22257 Hz", "undocumented", "22050 Hz", "44100 Hz" };
+
+	printf("  $807=%d (%s):%s", setting, nominalRates[setting], s->accepted ? "" : " not accepted,");
+	if (s->measured)
+	{
+		printf(" %lu.%03lu Hz, full->half %lu us, half->empty %lu us\n",
+				(unsigned long)(s->rateMilliHz / 1000), (unsigned long)(s->rateMilliHz % 1000),
+				(unsigned long)s->fullToHalfUs, (unsigned long)s->halfToEmptyUs);
+	}
+	else
+	{
+		printf(" didn't play\n");
+	}
+}
+
+// Prints what the tests measured in real time. These numbers depend on the CPU and
+// vary a little from run to run, so they're kept apart from the report above, which
+// is compared against known-good results.
+void PrintMeasurements(const TestResults *r)
+{
+	static const char *timerSourceNames[] = { "Ticks", "VIA1 timer 1", "VIA1 timer 2" };
+
+	if (!CanTestMachine(r->addrMapFlags))
+	{
+		return;
+	}
+
+	printf("Timer: %s, %lu ns resolution, %lu ns per timestamp\n",
+			(r->timerSource < sizeof(timerSourceNames)/sizeof(timerSourceNames[0])) ?
+				timerSourceNames[r->timerSource] : "?",
+			(unsigned long)r->timerResolutionNs, (unsigned long)r->timerOverheadNs);
+	if (r->timerLost)
+	{
+		printf("Timer: taken over by the OS during the tests, later timestamps came from Ticks\n");
+	}
+
+	// Results that count loop iterations, given in time too so machines with different
+	// CPUs can be compared
+	if (r->cpuNopNs)
+	{
+		printf("CPU speed: nop %lu ns, ASC read %lu ns, FIFO write %lu ns, fill loop %lu ns mono, %lu ns stereo\n",
+				(unsigned long)r->cpuNopNs, (unsigned long)r->cpuASCReadNs, (unsigned long)r->cpuFIFOWriteNs,
+				(unsigned long)r->cpuMonoFillNs, (unsigned long)r->cpuStereoFillNs);
+		if (r->shouldTestMono)
+		{
+			PrintFIFOFillTime("Mono FIFO", &r->monoFIFO, r->cpuMonoFillNs);
+		}
+		if (r->shouldTestStereo)
+		{
+			PrintFIFOFillTime("Stereo FIFO", &r->stereoFIFO, r->cpuStereoFillNs);
+		}
+		printf("Fill limit: 0x1000 writes take %lu us mono, %lu us stereo\n",
+				IterationsToUs(0x1000, r->cpuMonoFillNs), IterationsToUs(0x1000, r->cpuStereoFillNs));
+	}
+	else
+	{
+		printf("CPU speed: not calibrated\n");
+	}
+
+	// The rest are printed whenever they were measured; some only need Ticks
+	if (r->testedFIFOIRQs && r->fifoIRQPollLoops)
+	{
+		printf("FIFO IRQ max diffs are per main loop of %lu us\n",
+				(unsigned long)((4000000UL + r->fifoIRQPollLoops / 2) / r->fifoIRQPollLoops));
+	}
+	if (r->idleIRQWithoutF29FloodRate || r->idleIRQWithF29FloodRate ||
+			r->idleIRQRefireWithF29FloodRate || r->fifoIRQFloodRate)
+	{
+		printf("IRQ flood rate: idle %lu/s, idle with F29 %lu/s, refire %lu/s, FIFO %lu/s\n",
+				(unsigned long)r->idleIRQWithoutF29FloodRate, (unsigned long)r->idleIRQWithF29FloodRate,
+				(unsigned long)r->idleIRQRefireWithF29FloodRate, (unsigned long)r->fifoIRQFloodRate);
+	}
+
+	const DrainRateResults *d = &r->drainRate;
+	if (d->aMeasured)
+	{
+		PrintDrainRate('A', r->drainRateStereo, d->aFullToHalfUs, d->aHalfToEmptyUs,
+				d->aSampleRateMilliHz, d->aPeriodJitterUs);
+	}
+	if (d->bMeasured)
+	{
+		PrintDrainRate('B', r->drainRateStereo, d->bFullToHalfUs, d->bHalfToEmptyUs,
+				d->bSampleRateMilliHz, d->bPeriodJitterUs);
+	}
+	if (r->aDepthMeasured)
+	{
+		printf("FIFO A depth: %lu samples, half empty at %lu\n",
+				(unsigned long)r->aDepth, (unsigned long)r->aHalfEmptyLevel);
+	}
+	if (r->bDepthMeasured)
+	{
+		printf("FIFO B depth: %lu samples, half empty at %lu\n",
+				(unsigned long)r->bDepth, (unsigned long)r->bHalfEmptyLevel);
+	}
+	if (r->monoWriteRate.measured)
+	{
+		PrintWriteRate("Mono", &r->monoWriteRate);
+	}
+	if (r->stereoWriteRate.measured)
+	{
+		PrintWriteRate("Stereo", &r->stereoWriteRate);
+	}
+	if (r->checkedWideWrites)
+	{
+		printf("Samples per FIFO write: word %u, long %u\n",
+				r->samplesPerWordWrite, r->samplesPerLongWrite);
+	}
+	if (r->irqLatencySamples)
+	{
+		printf("IRQ latency (%lu IRQs): min %lu us, median %lu us, p99 %lu us, max %lu us\n",
+				(unsigned long)r->irqLatencySamples, (unsigned long)r->irqLatencyMinUs,
+				(unsigned long)r->irqLatencyMedianUs, (unsigned long)r->irqLatencyP99Us,
+				(unsigned long)r->irqLatencyMaxUs);
+		printf("IRQ latency histogram:");
+		for (int i = 0; i < IRQ_LATENCY_BUCKETS; i++)
+		{
+			if (i < IRQ_LATENCY_BUCKETS - 1)
+			{
+				printf(" <%lu: %lu", 8UL << i, (unsigned long)r->irqLatencyHistogram[i]);
+			}
+			else
+			{
+				printf(" more: %lu", (unsigned long)r->irqLatencyHistogram[i]);
+			}
+		}
+		printf(" (us)\n");
+	}
+	if (r->irqTimelineRecorded)
+	{
+		printf("FIFO IRQ timeline (FIFO %c, %lu IRQs, %lu dropped):\n", r->fifoIRQTestedWasA ? 'A' : 'B',
+				(unsigned long)r->irqTimelineIRQs, (unsigned long)r->irqTimelineDropped);
+		for (uint32_t i = 0; i < r->irqTimelineRunCount; i++)
+		{
+			PrintTimelineRun(&r->irqTimeline[i]);
+		}
+		if (r->irqTimelineMoreRuns)
+		{
+			printf("  ...and %lu more runs\n", (unsigned long)r->irqTimelineMoreRuns);
+		}
+		if (r->irqTimelineFlooded)
+		{
+			printf("  then flooded and was disabled\n");
+		}
+	}
+	if (r->irqCPUMeasured)
+	{
+		const char *separator = "";
+		printf("IRQ CPU use (main loop %lu/s without it):", (unsigned long)r->irqCPUBaselineRate);
+		if (r->irqCPUStreamMeasured)
+		{
+			printf(" streaming %lu.%lu%% at %lu IRQs/s", (unsigned long)(r->irqCPUStreamPermille / 10),
+					(unsigned long)(r->irqCPUStreamPermille % 10), (unsigned long)r->irqCPUStreamIRQRate);
+			separator = ",";
+		}
+		if (r->irqCPUIdleFloodMeasured)
+		{
+			printf("%s idle flood %lu.%lu%%", separator, (unsigned long)(r->irqCPUIdleFloodPermille / 10),
+					(unsigned long)(r->irqCPUIdleFloodPermille % 10));
+			separator = ",";
+		}
+		if (r->irqCPUIdleF29FloodMeasured)
+		{
+			printf("%s idle flood with F29 %lu.%lu%%", separator, (unsigned long)(r->irqCPUIdleF29FloodPermille / 10),
+					(unsigned long)(r->irqCPUIdleF29FloodPermille % 10));
+			separator = ",";
+		}
+		if (r->irqCPURefireFloodMeasured)
+		{
+			printf("%s refire %lu.%lu%%", separator, (unsigned long)(r->irqCPURefireFloodPermille / 10),
+					(unsigned long)(r->irqCPURefireFloodPermille % 10));
+		}
+		printf("\n");
+	}
+	if (r->monoStreaming.measured)
+	{
+		PrintStreaming("Mono", &r->monoStreaming);
+	}
+	if (r->stereoStreaming.measured)
+	{
+		PrintStreaming("Stereo", &r->stereoStreaming);
+	}
+	if (r->rateSweepTested)
+	{
+		printf("Clock rate sweep (FIFO %c, %s, $807 was $%02X):\n", r->rateSweepFIFOA ? 'A' : 'B',
+				r->drainRateStereo ? "stereo" : "mono", r->reg807InitialValue);
+		for (int i = 0; i < RATE_SETTINGS; i++)
+		{
+			PrintSampleRate(i, &r->rateSweep[i]);
+		}
+	}
+	if (r->wavetableTested)
+	{
+		printf("Wavetable: phase advances %d, $804 $%02X then $%02X, %lu IRQs/s%s", r->wavetablePhaseAdvances,
+				r->wavetable804Start, r->wavetable804Later, (unsigned long)r->wavetableIRQRate,
+				r->wavetableIRQFlooded ? " (flooded)" : "");
+		if (r->wavetableCPUMeasured)
+		{
+			// Compare with streaming 512 sample chunks, which is what a sound driver would use
+			const StreamingResults *s = r->stereoStreaming.measured ? &r->stereoStreaming : &r->monoStreaming;
+			printf(", CPU %lu.%lu%%", (unsigned long)(r->wavetableCPUPermille / 10),
+					(unsigned long)(r->wavetableCPUPermille % 10));
+			if (s->measured)
+			{
+				printf(" vs FIFO streaming %lu.%lu%%", (unsigned long)(s->cpuPermille[0] / 10),
+						(unsigned long)(s->cpuPermille[0] % 10));
+			}
+		}
+		printf("\n");
+	}
+}
+
+// How a result field is stored and written in the record
+enum ResultFieldType
+{
+	FieldBool,								// bool, written as 0 or 1
+	FieldUInt8,								// uint8_t, written in decimal
+	FieldHex8,								// uint8_t, written in hex
+	FieldHex16,								// uint16_t, written in hex
+	FieldUInt32,							// uint32_t, written in decimal
+	FieldHex32,								// uint32_t, written in hex
+	FieldHexLong							// long, written in hex
+};
+
+// One key of the result record
+struct ResultField
+{
+	const char *key;						// Key in the record
+	size_t offset;							// Where the value lives in TestResults
+	ResultFieldType type;					// How it's stored
+};
+
+#define RESULT_FIELD(name, type)			{ #name, offsetof(TestResults, name), type }
+#define DRAIN_RATE_RESULT_FIELDS(drain) \
+	RESULT_FIELD(drain.aMeasured, FieldBool), \
+	RESULT_FIELD(drain.bMeasured, FieldBool), \
+	RESULT_FIELD(drain.aFullToHalfUs, FieldUInt32), \
+	RESULT_FIELD(drain.bFullToHalfUs, FieldUInt32), \
+	RESULT_FIELD(drain.aHalfToEmptyUs, FieldUInt32), \
+	RESULT_FIELD(drain.bHalfToEmptyUs, FieldUInt32), \
+	RESULT_FIELD(drain.aSampleRateMilliHz, FieldUInt32), \
+	RESULT_FIELD(drain.bSampleRateMilliHz, FieldUInt32), \
+	RESULT_FIELD(drain.aPeriodJitterUs, FieldUInt32), \
+	RESULT_FIELD(drain.bPeriodJitterUs, FieldUInt32)
+#define WRITE_RATE_RESULT_FIELDS(rate) \
+	RESULT_FIELD(rate.measured, FieldBool), \
+	RESULT_FIELD(rate.byteRate, FieldUInt32), \
+	RESULT_FIELD(rate.unrolledRate, FieldUInt32), \
+	RESULT_FIELD(rate.wordRate, FieldUInt32), \
+	RESULT_FIELD(rate.longRate, FieldUInt32)
+#define IRQ_TIMELINE_RUN_FIELDS(run) \
+	RESULT_FIELD(run.status, FieldUInt8), \
+	RESULT_FIELD(run.count, FieldUInt32), \
+	RESULT_FIELD(run.startUs, FieldUInt32), \
+	RESULT_FIELD(run.spanUs, FieldUInt32)
+#define STREAMING_CHUNK_FIELDS(stream, n) \
+	RESULT_FIELD(stream.underruns[n], FieldUInt32), \
+	RESULT_FIELD(stream.irqRate[n], FieldUInt32), \
+	RESULT_FIELD(stream.refillAvgUs[n], FieldUInt32), \
+	RESULT_FIELD(stream.refillMaxUs[n], FieldUInt32), \
+	RESULT_FIELD(stream.cpuPermille[n], FieldUInt32)
+#define STREAMING_RESULT_FIELDS(stream) \
+	RESULT_FIELD(stream.measured, FieldBool), \
+	RESULT_FIELD(stream.fifoA, FieldBool), \
+	RESULT_FIELD(stream.minChunk, FieldUInt32), \
+	RESULT_FIELD(stream.refillTimed, FieldBool), \
+	STREAMING_CHUNK_FIELDS(stream, 0), \
+	STREAMING_CHUNK_FIELDS(stream, 1), \
+	STREAMING_CHUNK_FIELDS(stream, 2), \
+	STREAMING_CHUNK_FIELDS(stream, 3), \
+	STREAMING_CHUNK_FIELDS(stream, 4), \
+	STREAMING_CHUNK_FIELDS(stream, 5), \
+	STREAMING_CHUNK_FIELDS(stream, 6)
+#define SAMPLE_RATE_RESULT_FIELDS(rate) \
+	RESULT_FIELD(rate.accepted, FieldBool), \
+	RESULT_FIELD(rate.measured, FieldBool), \
+	RESULT_FIELD(rate.rateMilliHz, FieldUInt32), \
+	RESULT_FIELD(rate.fullToHalfUs, FieldUInt32), \
+	RESULT_FIELD(rate.halfToEmptyUs, FieldUInt32)
+#define FIFO_RESULT_FIELDS(fifo) \
+	RESULT_FIELD(fifo.aFullTooSoon, FieldBool), \
+	RESULT_FIELD(fifo.bFullTooSoon, FieldBool), \
+	RESULT_FIELD(fifo.aReachesFull, FieldBool), \
+	RESULT_FIELD(fifo.bReachesFull, FieldBool), \
+	RESULT_FIELD(fifo.aHalfEmptyIsOffWhenFull, FieldBool), \
+	RESULT_FIELD(fifo.bHalfEmptyIsOffWhenFull, FieldBool), \
+	RESULT_FIELD(fifo.aHalfEmptyTurnsOn, FieldBool), \
+	RESULT_FIELD(fifo.bHalfEmptyTurnsOn, FieldBool), \
+	RESULT_FIELD(fifo.aEmptyIsOffWhenHalfEmpty, FieldBool), \
+	RESULT_FIELD(fifo.bEmptyIsOffWhenHalfEmpty, FieldBool), \
+	RESULT_FIELD(fifo.aReachesEmpty, FieldBool), \
+	RESULT_FIELD(fifo.bReachesEmpty, FieldBool), \
+	RESULT_FIELD(fifo.aFullCount, FieldUInt32), \
+	RESULT_FIELD(fifo.bFullCount, FieldUInt32)
+
+// Every result in the record, in the order they're written. Temporary variables
+// used while testing aren't included.
+static const ResultField resultFields[] =
+{
+	RESULT_FIELD(boxFlag, FieldUInt8),
+	RESULT_FIELD(ascVersion, FieldHex8),
+	RESULT_FIELD(isSonoraVersion, FieldBool),
+	RESULT_FIELD(sysVersion, FieldHexLong),
+	RESULT_FIELD(addrMapFlags, FieldHex32),
+	RESULT_FIELD(regF09Exists, FieldBool),
+	RESULT_FIELD(regF29Exists, FieldBool),
+	RESULT_FIELD(regF09InitialValue, FieldHex8),
+	RESULT_FIELD(regF29InitialValue, FieldHex8),
+	RESULT_FIELD(reg804IdleValue, FieldHex8),
+	RESULT_FIELD(reg801InitialValue, FieldHex8),
+	RESULT_FIELD(acceptsMode0, FieldBool),
+	RESULT_FIELD(acceptsMode1, FieldBool),
+	RESULT_FIELD(acceptsMode2, FieldBool),
+	RESULT_FIELD(acceptsConfigMono, FieldBool),
+	RESULT_FIELD(acceptsConfigStereo, FieldBool),
+	RESULT_FIELD(shouldTestMono, FieldBool),
+	RESULT_FIELD(shouldTestStereo, FieldBool),
+	FIFO_RESULT_FIELDS(monoFIFO),
+	FIFO_RESULT_FIELDS(stereoFIFO),
+	RESULT_FIELD(via2AddressDecodeMask, FieldHex16),
+	RESULT_FIELD(via2MirroringOK, FieldBool),
+	RESULT_FIELD(via2ReadbackConsistent, FieldBool),
+	RESULT_FIELD(idleIRQWithoutF29, FieldBool),
+	RESULT_FIELD(idleIRQWithF29, FieldBool),
+	RESULT_FIELD(refiresIdleIRQWithF29, FieldBool),
+	RESULT_FIELD(floodsIRQWithoutF29, FieldBool),
+	RESULT_FIELD(floodsIRQWithF29, FieldBool),
+	RESULT_FIELD(refiresIdleIRQFloodWithF29, FieldBool),
+	RESULT_FIELD(irqFloodWithoutF29TakesOverCPU, FieldBool),
+	RESULT_FIELD(irqFloodWithF29TakesOverCPU, FieldBool),
+	RESULT_FIELD(irqFloodRefireWithF29TakesOverCPU, FieldBool),
+	RESULT_FIELD(idleIRQWithF29Count, FieldUInt32),
+	RESULT_FIELD(idleIRQWithoutF29Count, FieldUInt32),
+	RESULT_FIELD(testedFIFOIRQs, FieldBool),
+	RESULT_FIELD(fifoIRQTestedWasA, FieldBool),
+	RESULT_FIELD(gotIRQOnFIFOHalfEmptyTooSoon, FieldBool),
+	RESULT_FIELD(gotIRQOnFIFOEmptyTooSoon, FieldBool),
+	RESULT_FIELD(fullIRQCount, FieldUInt32),
+	RESULT_FIELD(halfEmptyIRQCount, FieldUInt32),
+	RESULT_FIELD(emptyIRQCount, FieldUInt32),
+	RESULT_FIELD(otherIRQCount, FieldUInt32),
+	RESULT_FIELD(fullIRQMaxDiff, FieldUInt32),
+	RESULT_FIELD(halfEmptyIRQMaxDiff, FieldUInt32),
+	RESULT_FIELD(emptyIRQMaxDiff, FieldUInt32),
+	RESULT_FIELD(otherIRQMaxDiff, FieldUInt32),
+	RESULT_FIELD(fifoIRQFiredAfterToggleWhenFull, FieldBool),
+	RESULT_FIELD(timerSource, FieldUInt8),
+	RESULT_FIELD(timerResolutionNs, FieldUInt32),
+	RESULT_FIELD(timerOverheadNs, FieldUInt32),
+	RESULT_FIELD(timerLost, FieldBool),
+	RESULT_FIELD(cpuNopNs, FieldUInt32),
+	RESULT_FIELD(cpuASCReadNs, FieldUInt32),
+	RESULT_FIELD(cpuFIFOWriteNs, FieldUInt32),
+	RESULT_FIELD(cpuMonoFillNs, FieldUInt32),
+	RESULT_FIELD(cpuStereoFillNs, FieldUInt32),
+	RESULT_FIELD(idleIRQWithoutF29FloodRate, FieldUInt32),
+	RESULT_FIELD(idleIRQWithF29FloodRate, FieldUInt32),
+	RESULT_FIELD(idleIRQRefireWithF29FloodRate, FieldUInt32),
+	RESULT_FIELD(fifoIRQFloodRate, FieldUInt32),
+	RESULT_FIELD(fifoIRQPollLoops, FieldUInt32),
+	RESULT_FIELD(drainRateStereo, FieldBool),
+	DRAIN_RATE_RESULT_FIELDS(drainRate),
+	RESULT_FIELD(aDepthMeasured, FieldBool),
+	RESULT_FIELD(bDepthMeasured, FieldBool),
+	RESULT_FIELD(aDepth, FieldUInt32),
+	RESULT_FIELD(bDepth, FieldUInt32),
+	RESULT_FIELD(aHalfEmptyLevel, FieldUInt32),
+	RESULT_FIELD(bHalfEmptyLevel, FieldUInt32),
+	WRITE_RATE_RESULT_FIELDS(monoWriteRate),
+	WRITE_RATE_RESULT_FIELDS(stereoWriteRate),
+	RESULT_FIELD(checkedWideWrites, FieldBool),
+	RESULT_FIELD(samplesPerWordWrite, FieldUInt8),
+	RESULT_FIELD(samplesPerLongWrite, FieldUInt8),
+	RESULT_FIELD(irqLatencySamples, FieldUInt32),
+	RESULT_FIELD(irqLatencyMinUs, FieldUInt32),
+	RESULT_FIELD(irqLatencyMedianUs, FieldUInt32),
+	RESULT_FIELD(irqLatencyP99Us, FieldUInt32),
+	RESULT_FIELD(irqLatencyMaxUs, FieldUInt32),
+	RESULT_FIELD(irqLatencyHistogram[0], FieldUInt32),
+	RESULT_FIELD(irqLatencyHistogram[1], FieldUInt32),
+	RESULT_FIELD(irqLatencyHistogram[2], FieldUInt32),
+	RESULT_FIELD(irqLatencyHistogram[3], FieldUInt32),
+	RESULT_FIELD(irqLatencyHistogram[4], FieldUInt32),
+	RESULT_FIELD(irqLatencyHistogram[5], FieldUInt32),
+	RESULT_FIELD(irqLatencyHistogram[6], FieldUInt32),
+	RESULT_FIELD(irqLatencyHistogram[7], FieldUInt32),
+	RESULT_FIELD(irqTimelineRecorded, FieldBool),
+	RESULT_FIELD(irqTimelineFlooded, FieldBool),
+	RESULT_FIELD(irqTimelineIRQs, FieldUInt32),
+	RESULT_FIELD(irqTimelineDropped, FieldUInt32),
+	RESULT_FIELD(irqTimelineRunCount, FieldUInt32),
+	RESULT_FIELD(irqTimelineMoreRuns, FieldUInt32),
+	IRQ_TIMELINE_RUN_FIELDS(irqTimeline[0]),
+	IRQ_TIMELINE_RUN_FIELDS(irqTimeline[1]),
+	IRQ_TIMELINE_RUN_FIELDS(irqTimeline[2]),
+	IRQ_TIMELINE_RUN_FIELDS(irqTimeline[3]),
+	IRQ_TIMELINE_RUN_FIELDS(irqTimeline[4]),
+	IRQ_TIMELINE_RUN_FIELDS(irqTimeline[5]),
+	IRQ_TIMELINE_RUN_FIELDS(irqTimeline[6]),
+	IRQ_TIMELINE_RUN_FIELDS(irqTimeline[7]),
+	RESULT_FIELD(irqCPUMeasured, FieldBool),
+	RESULT_FIELD(irqCPUBaselineRate, FieldUInt32),
+	RESULT_FIELD(irqCPUStreamMeasured, FieldBool),
+	RESULT_FIELD(irqCPUStreamPermille, FieldUInt32),
+	RESULT_FIELD(irqCPUStreamIRQRate, FieldUInt32),
+	RESULT_FIELD(irqCPUIdleFloodMeasured, FieldBool),
+	RESULT_FIELD(irqCPUIdleFloodPermille, FieldUInt32),
+	RESULT_FIELD(irqCPUIdleF29FloodMeasured, FieldBool),
+	RESULT_FIELD(irqCPUIdleF29FloodPermille, FieldUInt32),
+	RESULT_FIELD(irqCPURefireFloodMeasured, FieldBool),
+	RESULT_FIELD(irqCPURefireFloodPermille, FieldUInt32),
+	STREAMING_RESULT_FIELDS(monoStreaming),
+	STREAMING_RESULT_FIELDS(stereoStreaming),
+	RESULT_FIELD(rateSweepTested, FieldBool),
+	RESULT_FIELD(rateSweepFIFOA, FieldBool),
+	RESULT_FIELD(reg807InitialValue, FieldHex8),
+	SAMPLE_RATE_RESULT_FIELDS(rateSweep[0]),
+	SAMPLE_RATE_RESULT_FIELDS(rateSweep[1]),
+	SAMPLE_RATE_RESULT_FIELDS(rateSweep[2]),
+	SAMPLE_RATE_RESULT_FIELDS(rateSweep[3]),
+	RESULT_FIELD(wavetableTested, FieldBool),
+	RESULT_FIELD(wavetablePhaseAdvances, FieldBool),
+	RESULT_FIELD(wavetable804Start, FieldHex8),
+	RESULT_FIELD(wavetable804Later, FieldHex8),
+	RESULT_FIELD(wavetableIRQFlooded, FieldBool),
+	RESULT_FIELD(wavetableIRQRate, FieldUInt32),
+	RESULT_FIELD(wavetableCPUMeasured, FieldBool),
+	RESULT_FIELD(wavetableCPUPermille, FieldUInt32),
+	RESULT_FIELD(ascVBLTaskDisabled, FieldBool),
+};
+
+// Writes the results as a record of key=value lines. The first line identifies the
+// format and its version, and the record ends with an "end" line.
+void WriteResultRecord(FILE *f, const TestResults *r)
+{
+	fprintf(f, "ASCTesterResults %d\n", RESULT_RECORD_VERSION);
+	fprintf(f, "testVersion=%d\n", TEST_VERSION);
+	for (size_t i = 0; i < sizeof(resultFields)/sizeof(resultFields[0]); i++)
+	{
+		const ResultField *field = &resultFields[i];
+		const void *value = (const uint8_t *)r + field->offset;
+		switch (field->type)
+		{
+		case FieldBool:
+			fprintf(f, "%s=%d\n", field->key, *(const bool *)value);
+			break;
+		case FieldUInt8:
+			fprintf(f, "%s=%u\n", field->key, *(const uint8_t *)value);
+			break;
+		case FieldHex8:
+			fprintf(f, "%s=0x%02X\n", field->key, *(const uint8_t *)value);
+			break;
+		case FieldHex16:
+			fprintf(f, "%s=0x%04X\n", field->key, *(const uint16_t *)value);
+			break;
+		case FieldUInt32:
+			fprintf(f, "%s=%lu\n", field->key, (unsigned long)*(const uint32_t *)value);
+			break;
+		case FieldHex32:
+			fprintf(f, "%s=0x%08lX\n", field->key, (unsigned long)*(const uint32_t *)value);
+			break;
+		case FieldHexLong:
+			fprintf(f, "%s=0x%04lX\n", field->key, *(const long *)value);
+			break;
+		}
+	}
+	fprintf(f, "end\n");
+}
+
+// Stores one key=value pair of a record in r. Returns false if the key isn't known,
+// which is expected when reading a record from a newer version of the tests.
+static bool ResultRecordField(const char *key, const char *value, TestResults *r)
+{
+	for (size_t i = 0; i < sizeof(resultFields)/sizeof(resultFields[0]); i++)
+	{
+		const ResultField *field = &resultFields[i];
+		if (strcmp(field->key, key))
+		{
+			continue;
+		}
+
+		void *dest = (uint8_t *)r + field->offset;
+		const unsigned long n = strtoul(value, NULL, 0);
+		switch (field->type)
+		{
+		case FieldBool:
+			*(bool *)dest = n != 0;
+			break;
+		case FieldUInt8:
+		case FieldHex8:
+			*(uint8_t *)dest = (uint8_t)n;
+			break;
+		case FieldHex16:
+			*(uint16_t *)dest = (uint16_t)n;
+			break;
+		case FieldUInt32:
+		case FieldHex32:
+			*(uint32_t *)dest = (uint32_t)n;
+			break;
+		case FieldHexLong:
+			*(long *)dest = (long)n;
+			break;
+		}
+		return true;
+	}
+	return false;
+}
+
+// Reads the next record in f into r. Returns false if there isn't one, or if it's in
+// a format version we don't understand.
+bool ReadResultRecord(FILE *f, TestResults *r)
+{
+	char line[256];
+	int version = 0;
+
+	// Find the start of the record
+	while (fgets(line, sizeof(line), f))
+	{
+		if (sscanf(line, "ASCTesterResults %d", &version) == 1)
+		{
+			break;
+		}
+	}
+	if (version < 1 || version > RESULT_RECORD_VERSION)
+	{
+		return false;
+	}
+
+	memset(r, 0, sizeof(*r));
+	while (fgets(line, sizeof(line), f))
+	{
+		line[strcspn(line, "\r\n")] = 0;
+		if (!strcmp(line, "end"))
+		{
+			return true;
+		}
+
+		char *equals = strchr(line, '=');
+		if (equals)
+		{
+			*equals = 0;
+			ResultRecordField(line, equals + 1, r);
+		}
+	}
+	return false;
+}
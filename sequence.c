@@ -0,0 +1,251 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "asctester.h"
+#include "sequence.h"
+
+// IRQ handler installed while a sequence plays. It clears and acknowledges whatever
+// came in, and turns the ASC IRQ off if it floods.
+static void SeqIRQHandler(void)
+{
+	(void)ascReadReg(0x804);
+	via2WriteReg(0x1A03, 0x90);
+
+	SeqPlayer *p = *(SeqPlayer **)applScratch();
+	if (++p->irqCount >= SEQ_IRQ_FLOOD_COUNT)
+	{
+		via2WriteReg(0x1C13, 0x10);
+	}
+}
+
+// Whether an operation records something when it's played
+bool SeqObserves(const SeqOp *op)
+{
+	return op->type == SeqASCRead || op->type == SeqVIA2Read || op->type == SeqWait;
+}
+
+// Gets ready to play a sequence: installs the IRQ handler and starts from FIFO mode,
+// mono, empty FIFOs, and the ASC IRQ off
+void SeqBegin(SeqPlayer *p)
+{
+	const uint16_t irqState = DisableIRQ();
+	p->irqCount = 0;
+	p->originalMode = ascReadReg(0x801);
+	p->originalControl = ascReadReg(0x802);
+	p->originalF09Value = ascReadReg(0xF09);
+	p->originalF29Value = ascReadReg(0xF29);
+	p->irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
+	p->originalASCIRQHandler = via2Handlers()[4];
+
+	*(SeqPlayer **)applScratch() = p;
+	via2Handlers()[4] = SeqIRQHandler;
+	via2WriteReg(0x1C13, 0x10);
+	ascWriteReg(0x801, 1);
+	ascWriteReg(0x802, p->originalControl & ~0x02);
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+	ascWriteReg(0xF09, 1);
+	ascWriteReg(0xF29, 1);
+	(void)ascReadReg(0x804);
+	via2WriteReg(0x1A03, 0x90);
+	RestoreIRQ(irqState);
+}
+
+// Plays one operation. Returns what a read returned, or for a wait, how many IRQs were
+// taken since the previous wait (0 for everything else).
+uint16_t SeqStep(SeqPlayer *p, const SeqOp *op)
+{
+	uint16_t value = 0;
+
+	switch (op->type)
+	{
+	case SeqASCWrite:
+		ascWriteReg(op->address, op->value);
+		break;
+	case SeqASCRead:
+		value = ascReadReg(op->address);
+		break;
+	case SeqVIA2Write:
+		via2WriteReg(op->address, op->value);
+		break;
+	case SeqVIA2Read:
+		value = via2ReadReg(op->address);
+		break;
+	case SeqFill:
+		for (uint16_t s = 0; s < op->value; s++)
+		{
+			ascWriteReg(op->address, 0x80);
+		}
+		break;
+	case SeqWait:
+	{
+		waitTicks(op->value);
+		const uint16_t irqState = DisableIRQ();
+		value = p->irqCount;
+		p->irqCount = 0;
+		RestoreIRQ(irqState);
+		break;
+	}
+	}
+
+	return value;
+}
+
+// Puts the registers the tests care about back the way they were
+void SeqEnd(SeqPlayer *p)
+{
+	const uint16_t irqState = DisableIRQ();
+	via2WriteReg(0x1C13, 0x10);
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+	ascWriteReg(0x801, p->originalMode);
+	ascWriteReg(0x802, p->originalControl);
+	ascWriteReg(0xF09, p->originalF09Value);
+	ascWriteReg(0xF29, p->originalF29Value);
+	(void)ascReadReg(0x804);
+	via2WriteReg(0x1A03, 0x90);
+	via2Handlers()[4] = p->originalASCIRQHandler;
+	via2WriteReg(0x1C13, p->irqOriginallyEnabledInVIA2 ? 0x90 : 0x10);
+	RestoreIRQ(irqState);
+}
+
+// Plays a whole sequence. If observed isn't NULL, it gets what SeqStep returned for
+// each operation.
+void SeqRun(const SeqOp *ops, uint32_t count, uint16_t *observed)
+{
+	SeqPlayer p;
+
+	SeqBegin(&p);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const uint16_t value = SeqStep(&p, &ops[i]);
+		if (observed)
+		{
+			observed[i] = value;
+		}
+	}
+	SeqEnd(&p);
+}
+
+// Parses one line of a sequence file. Returns false if it isn't a valid operation.
+static bool ParseOp(const char *line, SeqOp *op)
+{
+	char name[8];
+	unsigned address, value;
+	int fields = sscanf(line, "%7s %x %x", name, &address, &value);
+
+	if (fields == 3 && !strcmp(name, "w") && address < 0x1000 && value <= 0xFF)
+	{
+		op->type = SeqASCWrite;
+	}
+	else if (fields == 2 && !strcmp(name, "r") && address < 0x1000)
+	{
+		op->type = SeqASCRead;
+		value = 0;
+	}
+	else if (fields == 3 && !strcmp(name, "vw") && address < 0x2000 && value <= 0xFF)
+	{
+		op->type = SeqVIA2Write;
+	}
+	else if (fields == 2 && !strcmp(name, "vr") && address < 0x2000)
+	{
+		op->type = SeqVIA2Read;
+		value = 0;
+	}
+	else if (!strcmp(name, "fill") && sscanf(line, "%7s %x %u", name, &address, &value) == 3 &&
+		address < 0x800 && value <= 0xFFFF)
+	{
+		op->type = SeqFill;
+	}
+	else if (!strcmp(name, "wait") && sscanf(line, "%7s %u", name, &value) == 2 && value <= 0xFFFF)
+	{
+		op->type = SeqWait;
+		address = 0;
+	}
+	else
+	{
+		return false;
+	}
+
+	op->address = address;
+	op->value = value;
+	return true;
+}
+
+// Reads a sequence file. Prints the first line it doesn't understand and returns false.
+bool SeqReadFile(FILE *f, SeqOp *ops, uint32_t maxOps, uint32_t *count)
+{
+	char line[128];
+	uint32_t lineNumber = 0;
+
+	*count = 0;
+	while (fgets(line, sizeof(line), f))
+	{
+		lineNumber++;
+		line[strcspn(line, "#\r\n")] = 0;
+		char word[2];
+		if (sscanf(line, "%1s", word) != 1)
+		{
+			continue;
+		}
+
+		if (*count == maxOps)
+		{
+			printf("Sequence is longer than %lu operations\n", (unsigned long)maxOps);
+			return false;
+		}
+		if (!ParseOp(line, &ops[*count]))
+		{
+			printf("Sequence line %lu isn't a valid operation: %s\n", (unsigned long)lineNumber, line);
+			return false;
+		}
+		(*count)++;
+	}
+	return true;
+}
+
+// Writes an operation the way SeqReadFile expects it (without a newline)
+void SeqWriteOp(FILE *f, const SeqOp *op)
+{
+	switch (op->type)
+	{
+	case SeqASCWrite:
+		fprintf(f, "w %03X %02X", op->address, op->value);
+		break;
+	case SeqASCRead:
+		fprintf(f, "r %03X", op->address);
+		break;
+	case SeqVIA2Write:
+		fprintf(f, "vw %04X %02X", op->address, op->value);
+		break;
+	case SeqVIA2Read:
+		fprintf(f, "vr %04X", op->address);
+		break;
+	case SeqFill:
+		fprintf(f, "fill %03X %u", op->address, op->value);
+		break;
+	case SeqWait:
+		fprintf(f, "wait %u", op->value);
+		break;
+	}
+}
+
+// Prints what an observing operation saw, one per line
+void SeqPrintObserved(FILE *f, const SeqOp *op, uint16_t observed)
+{
+	if (!SeqObserves(op))
+	{
+		return;
+	}
+
+	SeqWriteOp(f, op);
+	if (op->type == SeqWait)
+	{
+		fprintf(f, ": %u IRQs%s\n", observed, (observed >= SEQ_IRQ_FLOOD_COUNT) ? " (flood, turned off)" : "");
+	}
+	else
+	{
+		fprintf(f, " = $%02X\n", observed);
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "asctester.h"
+
+// Register sequences. A sequence is a list of ASC and VIA2 operations that gets played
+// back with an IRQ handler installed, recording what every read returns and how many
+// IRQs arrive during each wait. The host fuzzer generates them to compare simulated
+// machines, and ASCTester plays them on a real Mac from a file named
+// "ASCTester Sequence" to find out which machine was right.
+//
+// In the file, each line holds one operation (anything after a # is ignored):
+//   w <reg> <value>        Write an ASC register
+//   r <reg>                Read an ASC register
+//   vw <reg> <value>       Write a VIA2 register
+//   vr <reg>               Read a VIA2 register
+//   fill <reg> <count>     Write count silent samples to a FIFO ($000 = A, $400 = B)
+//   wait <ticks>           Wait with IRQs enabled
+// Registers and values are in hex, counts and ticks in decimal.
+
+// Most operations a sequence file can hold
+#define SEQ_MAX_OPS					4096
+
+// IRQs taken between two waits before the handler turns the ASC IRQ off
+#define SEQ_IRQ_FLOOD_COUNT			1000
+
+enum SeqOpType
+{
+	SeqASCWrite,
+	SeqASCRead,
+	SeqVIA2Write,
+	SeqVIA2Read,
+	SeqFill,
+	SeqWait
+};
+
+// One operation
+struct SeqOp
+{
+	SeqOpType type;
+	uint16_t address;						// Register offset (the FIFO's offset for SeqFill)
+	uint16_t value;							// Value written, samples for SeqFill, or ticks for SeqWait
+};
+
+// A sequence being played. SeqRun plays a whole one; SeqBegin, SeqStep, and SeqEnd let
+// the caller stop partway, which the host uses to branch from the middle of a sequence.
+// The IRQ handler finds the player through ApplScratch, so it mustn't move while playing.
+struct SeqPlayer
+{
+	uint16_t irqCount;						// IRQs taken since the last wait
+	uint8_t originalMode;					// Registers to put back at the end
+	uint8_t originalControl;
+	uint8_t originalF09Value;
+	uint8_t originalF29Value;
+	bool irqOriginallyEnabledInVIA2;
+	VIA2Handler originalASCIRQHandler;
+};
+
+bool SeqObserves(const SeqOp *op);
+void SeqBegin(SeqPlayer *p);
+uint16_t SeqStep(SeqPlayer *p, const SeqOp *op);
+void SeqEnd(SeqPlayer *p);
+void SeqRun(const SeqOp *ops, uint32_t count, uint16_t *observed);
+bool SeqReadFile(FILE *f, SeqOp *ops, uint32_t maxOps, uint32_t *count);
+void SeqWriteOp(FILE *f, const SeqOp *op);
+void SeqPrintObserved(FILE *f, const SeqOp *op, uint16_t observed);
+
+#endif
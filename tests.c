@@ -5,114 +5,97 @@
 #include <string.h>
 #include <Gestalt.h>
 #include "asctester.h"
-
-// How many IRQs we receive before we consider it "flooding"
+#include "tests.h"
+#include "sequence.h"
+#include "timing.h"
+#include "irqevents.h"
+
+// How many IRQs we receive before we consider it "flooding" regardless of how fast they
+// came. An IRQ count is set to this once a flood is confirmed, which is how the report
+// has always shown a flood.
 #define IRQ_FLOOD_TEST_COUNT				50000
 
-typedef void (*ASCTestFunc)(void);
-
-// Results for a FIFO test, kept in a different struct because we can test mono and stereo separately
-struct FIFOTestResults
-{
-	bool aFullTooSoon;						// After writing 0x100 samples to the ASC, bit 1 of reg 0x804 is already 1,
-											// which indicates it's probably not actually a playback FIFO bit
-	bool bFullTooSoon;						// After writing 0x100 samples to the ASC, bit 3 of reg 0x804 is already 1,
-											// which indicates it's probably not actually a playback FIFO bit
-	bool aReachesFull;						// When we flood the ASC with writes, bit 1 of reg 0x804 eventually becomes 1
-	bool bReachesFull;						// When we flood the ASC with writes, bit 3 of reg 0x804 eventually becomes 1
-	bool aHalfEmptyIsOffWhenFull;			// (Only if aReachesFull) Bit 0 of reg 0x804 is 0 when we first notice bit 1 is 1
-	bool bHalfEmptyIsOffWhenFull;			// (Only if bReachesFull) Bit 2 of reg 0x804 is 0 when we first notice bit 3 is 1
-	bool aHalfEmptyTurnsOn;					// (Only if aReachesFull) Bit 0 of reg 0x804 eventually becomes 1 again
-	bool bHalfEmptyTurnsOn;					// (Only if bReachesFull) Bit 2 of reg 0x804 eventually becomes 1 again
-	bool aEmptyIsOffWhenHalfEmpty;			// (Only if aHalfEmptyTurnsOn) Bit 1 of reg 0x804 is 0 when we first notice bit 0
-											// is 1 as the FIFO is draining
-	bool bEmptyIsOffWhenHalfEmpty;			// (Only if bHalfEmptyTurnsOn) Bit 3 of reg 0x804 is 0 when we first notice bit 2
-											// is 1 as the FIFO is draining
-	bool aReachesEmpty;						// (Only if aReachesFull) we eventually notice bit 1 of reg 0x804 become 1 again
-											// to indicate that FIFO A is completely empty
-	bool bReachesEmpty;						// (Only if bReachesFull) we eventually notice bit 3 of reg 0x804 become 1 again
-											// to indicate that FIFO B is completely empty
-	uint32_t aFullCount;					// Number of samples written to FIFO A before it's marked as full
-	uint32_t bFullCount;					// Number of samples written to FIFO B before it's marked as full
-};
-
-// Test results
-struct TestResults
-{
-	uint8_t ascVersion;						// ASC revision identifier byte
-	bool isSonoraVersion;					// High nibble of ASC revision is 0xB
-	uint8_t boxFlag;						// Machine identifier byte
-	long sysVersion;						// The system version
-	bool regF09Exists;						// Whether reg 0xF09 appears to exist
-	bool regF29Exists;						// Whether reg 0xF29 appears to exist
-	uint8_t regF09InitialValue;				// Value of reg 0xF09 we first observe (if it exists)
-	uint8_t regF29InitialValue;				// Value of reg 0xF29 we first observe (if it exists)
-	uint8_t reg804IdleValue;				// Value of reg 0x804 when ASC is idle
-	uint8_t reg801InitialValue;				// Value of reg 0x801 we first observe
-	bool acceptsMode0;						// Allows writing 0 to reg 0x801
-	bool acceptsMode1;						// Allows writing 1 to reg 0x801
-	bool acceptsMode2;						// Allows writing 2 to reg 0x801
-	bool acceptsConfigMono;					// Allows writing 0 to bit 1 of reg 0x802
-	bool acceptsConfigStereo;				// Allows writing 1 to bit 1 of reg 0x802
-	bool shouldTestMono;					// Whether we should actually test mono
-	bool shouldTestStereo;					// Whether we should actually test stereo
-	struct FIFOTestResults monoFIFO;		// FIFO test results in mono mode
-	struct FIFOTestResults stereoFIFO;		// FIFO test results in stereo mode
-	uint16_t via2AddressDecodeMask;			// Mask of bits that appear to be decoded inside the first 0x200 bytes of VIA2.
-											// If it's 0, it likely means it's a real VIA with a different register every
-											// 0x200 bytes in the VIA2 address space.
-	bool via2MirroringOK;					// Whether the address mirroring of the VIA2 registers works correctly
-	bool via2ReadbackConsistent;			// Whether we read back 2 identical copies of the beginning of VIA2 space during our test
-	volatile uint32_t tmpIRQCount;			// Temporary counter used during IRQ tests
-	bool idleIRQWithoutF29;					// An IRQ fires immediately when you enable IRQs without register F29 enabled
-	bool idleIRQWithF29;					// An IRQ fires immediately when you enable IRQs with register F29 enabled
-	bool refiresIdleIRQWithF29;				// An IRQ fires immediately if you disable and re-enable F29 again
-	bool floodsIRQWithoutF29;				// Floods IRQ when idle without register F29 enabled
-	bool floodsIRQWithF29;					// Floods IRQ when idle with register F29 enabled (if available)
-	bool refiresIdleIRQFloodWithF29;		// Floods IRQ when idle if you disable and re-enable F29 again
-	bool irqFloodWithoutF29TakesOverCPU;	// (Only if floodsIRQWithoutF29) the IRQ flood takes over the CPU
-	bool irqFloodWithF29TakesOverCPU;		// (Only if floodsIRQWithF29) the IRQ flood takes over the CPU
-	bool irqFloodRefireWithF29TakesOverCPU;	// (Only if refiresIdleIRQFloodWithF29) the IRQ flood takes over the CPU again
-	uint32_t idleIRQWithF29Count;			// Total count of IRQs observed at idle without F29 enabled
-	uint32_t idleIRQWithoutF29Count;		// Total count of IRQs observed at idle with F29 enabled (if available)
-	uint32_t irqCountTest;					// Temporary variable
-	bool testedFIFOIRQs;					// True if we actually tested FIFO IRQs. False if we didn't find
-											// a working FIFO during our polling tests.
-	bool fifoIRQTestedWasA;					// True if FIFO A was tested for IRQs; false if FIFO B was tested
-	bool gotIRQOnFIFOHalfEmptyTooSoon;		// True if the half empty IRQ was too soon to be real (immediate IRQ)
-	bool gotIRQOnFIFOEmptyTooSoon;			// True if the empty IRQ was too soon to be real
-	volatile uint32_t fullIRQCount;			// Count of "FIFO full" IRQs we observed
-	volatile uint32_t halfEmptyIRQCount;	// Count of "FIFO half empty" IRQs we observed
-	volatile uint32_t emptyIRQCount;		// Count of "FIFO empty" IRQs we observed
-	volatile uint32_t otherIRQCount;		// Count of other IRQs we observed
-	uint32_t fullIRQMaxDiff;				// Maximum difference in fullIRQCount we see while waiting 4 seconds
-	uint32_t halfEmptyIRQMaxDiff;			// Maximum difference in halfEmptyIRQCount we see while waiting 4 seconds
-	uint32_t emptyIRQMaxDiff;				// Maximum difference in emptyIRQCount we see while waiting 4 seconds
-	uint32_t otherIRQMaxDiff;				// Maximum difference in otherIRQCount we see while waiting 4 seconds
-	volatile bool fifoIRQFiredAfterToggleWhenFull;	// True if an IRQ fired after we toggled the IRQ off and back on,
-													// even though FIFO was full and thus no conditions should
-													// have been met to cause an IRQ to fire at that time.
-													// If F29 exists, we use that for the toggle. Otherwise, VIA2.
-};
-
-static void DisableASCVBLTask(void);
-static void RestoreASCVBLTask(void);
-
-static void Test_MachineInfo(void);
-static void Test_RegF09F29Exists(void);
-static void Test_Reg804Idle(void);
-static void Test_ModeRegisterConfigurable(void);
-static void Test_MonoStereoConfigurable(void);
-static void Test_FIFOFullHalfFullEmpty_Mono(void);
-static void Test_FIFOFullHalfFullEmpty_Stereo(void);
-
-static void Test_VIA2Repeat(void);
-static void Test_VIA2Mirror(void);
-
-static void Test_IdleIRQWithoutF29(void);
-static void Test_IdleIRQWithF29(void);
-static void Test_FIFOIRQ(void);
-static void Test_FIFOIRQ_WhileFull(void);
+// Some variants send a burst of a few thousand half empty IRQs while the FIFO drains
+// from half empty to empty (the most seen on working hardware is about 4600), so IRQs
+// are only timed once there have been more than IRQ_FLOOD_TIMED_AFTER. That leaves the
+// handler as it always was for everything short of a flood. From there they're timed in
+// windows of IRQ_FLOOD_WINDOW, and if they keep arriving faster than IRQ_FLOOD_RATE per
+// second for IRQ_FLOOD_MIN_US, it's a flood.
+#define IRQ_FLOOD_TIMED_AFTER				5000
+#define IRQ_FLOOD_WINDOW					256
+#define IRQ_FLOOD_RATE						5000
+#define IRQ_FLOOD_MIN_US					100000
+
+// Iterations of each loop the CPU speed calibration times, and how many times it times
+// them (keeping the fastest, which is the one least disturbed by anything else)
+#define CALIBRATION_ITERATIONS				0x180
+#define CALIBRATION_RUNS					5
+
+// The drain rate test times how long the FIFOs take to play this many samples, this
+// many times over
+#define DRAIN_BLOCK_SAMPLES					0x100
+#define DRAIN_BLOCKS						8
+
+// Number of times the FIFO depth test fills the FIFOs, averaging what it finds
+#define FIFO_DEPTH_RUNS						4
+
+// Samples written to each FIFO while timing how fast they can be written
+#define WRITE_RATE_SAMPLES					0x200
+
+// How long the main program's work is timed for in the IRQ CPU use test (longer while
+// streaming, which only interrupts a few dozen times a second; shorter in a flood, which
+// gets disabled soon after it's confirmed), how many nops one unit of that work is, and
+// how many samples the streaming handler writes each time the FIFO is half empty
+#define IRQ_CPU_WINDOW_US					100000
+#define IRQ_CPU_STREAM_WINDOW_US			1000000
+#define IRQ_CPU_WORK_NOPS					16
+#define IRQ_CPU_REFILL_SAMPLES				0x200
+
+// The streaming test plays for STREAM_RUN_US with each chunk size. If no IRQ comes for
+// STREAM_STALL_US (longer than a full FIFO takes to play), the stream has stopped and
+// gets restarted.
+#define STREAM_RUN_US						1000000
+#define STREAM_STALL_US						100000
+
+// Wavetable mode has four voices, each playing a table of WAVETABLE_SAMPLES samples. The
+// tables take up $000-$7FF; voice n's phase is at $810 + 8n and its phase increment at
+// $814 + 8n, each a 32-bit value whose bits 15-23 index the table.
+#define WAVETABLE_VOICES					4
+#define WAVETABLE_SAMPLES					0x200
+#define WAVETABLE_REGS						0x810
+#define WAVETABLE_REGS_SIZE					(WAVETABLE_VOICES * 8)
+
+typedef void (*ASCTestFunc)(TestResults *r);
+
+static void DisableASCVBLTask(TestResults *r);
+static void RestoreASCVBLTask(TestResults *r);
+
+static void Test_MachineInfo(TestResults *r);
+static void Test_RegF09F29Exists(TestResults *r);
+static void Test_Reg804Idle(TestResults *r);
+static void Test_ModeRegisterConfigurable(TestResults *r);
+static void Test_MonoStereoConfigurable(TestResults *r);
+static void Test_FIFOFullHalfFullEmpty_Mono(TestResults *r);
+static void Test_FIFOFullHalfFullEmpty_Stereo(TestResults *r);
+
+static void Test_VIA2Repeat(TestResults *r);
+static void Test_VIA2Mirror(TestResults *r);
+
+static void Test_IdleIRQWithoutF29(TestResults *r);
+static void Test_IdleIRQWithF29(TestResults *r);
+static void Test_FIFOIRQ(TestResults *r);
+static void Test_FIFOIRQ_WhileFull(TestResults *r);
+static void Test_Timer(TestResults *r);
+static void Test_CPUSpeed(TestResults *r);
+static void Test_DrainRate(TestResults *r);
+static void Test_FIFODepth(TestResults *r);
+static void Test_FIFOWriteRate(TestResults *r);
+static void Test_IRQLatency(TestResults *r);
+static void Test_FIFOIRQTimeline(TestResults *r);
+static void Test_IRQCPUUse(TestResults *r);
+static void Test_Streaming(TestResults *r);
+static void Test_SampleRateSweep(TestResults *r);
+static void Test_Wavetable(TestResults *r);
 
 // List of all tests
 static ASCTestFunc tests[] =
@@ -127,15 +110,28 @@ static ASCTestFunc tests[] =
 	Test_FIFOFullHalfFullEmpty_Stereo,
 	Test_VIA2Repeat,
 	Test_VIA2Mirror,
+	// Starts the clock used by the IRQ flood detection below and the timing tests after
+	// it. Everything before here depends on FIFO timing, so it has to come after them.
+	Test_Timer,
 	Test_IdleIRQWithoutF29,
 	Test_IdleIRQWithF29,
 	Test_FIFOIRQ,
 	Test_FIFOIRQ_WhileFull,
+	// Tests that measure time come after the others, so taking timestamps doesn't
+	// change how the tests above behave
+	Test_CPUSpeed,
+	Test_DrainRate,
+	Test_FIFODepth,
+	Test_FIFOWriteRate,
+	Test_IRQLatency,
+	Test_FIFOIRQTimeline,
+	Test_IRQCPUUse,
+	Test_Streaming,
+	Test_SampleRateSweep,
+	Test_Wavetable,
 	RestoreASCVBLTask,
 };
 
-static struct TestResults results;
-
 // Temporary buffer for storing stuff
 union TempBuffer
 {
@@ -143,12 +139,6 @@ union TempBuffer
 	uint32_t words[0x80];
 };
 
-static union TempBuffer buf;
-static union TempBuffer buf2;
-
-static VBLTask *ascVBLTask;
-static ProcPtr originalASCVBLFunc;
-
 // A simple VBL task function that does nothing and schedules
 // itself to run again in 30 ticks
 #pragma parameter DummyASCVBLTask(__A0)
@@ -159,7 +149,7 @@ static void DummyASCVBLTask(VBLTask *task)
 
 // The Quadra 700 and 900 have a VBL task that interferes with ASCTester's
 // IRQ tests. Locate it and disable it if it exists.
-static void DisableASCVBLTask(void)
+static void DisableASCVBLTask(TestResults *r)
 {
 	const uint16_t irqState = DisableIRQ();
 	QHdr vblQueue = LMGetVBLQueue();
@@ -175,8 +165,9 @@ static void DisableASCVBLTask(void)
 			};
 			if (!memcmp((uint8_t *)task->vblAddr, ascVBLStart, sizeof(ascVBLStart)))
 			{
-				ascVBLTask = task;
-				originalASCVBLFunc = task->vblAddr;
+				r->ascVBLTaskDisabled = true;
+				r->ascVBLTask = task;
+				r->originalASCVBLFunc = task->vblAddr;
 				task->vblAddr = (ProcPtr)DummyASCVBLTask;
 
 				// We found it, bail now
@@ -188,41 +179,168 @@ static void DisableASCVBLTask(void)
 	}
 
 	// Didn't find one
-	ascVBLTask = NULL;
+	r->ascVBLTaskDisabled = false;
+	r->ascVBLTask = NULL;
 	RestoreIRQ(irqState);
 }
 
 // Restore the VBL task if we disabled it.
-static void RestoreASCVBLTask(void)
+static void RestoreASCVBLTask(TestResults *r)
 {
 	const uint16_t irqState = DisableIRQ();
-	if (ascVBLTask)
+	if (r->ascVBLTaskDisabled)
 	{
-		ascVBLTask->vblAddr = originalASCVBLFunc;
+		r->ascVBLTask->vblAddr = r->originalASCVBLFunc;
 	}
 	RestoreIRQ(irqState);
 }
 
 // Just grabs the ASC version and BoxFlag
-static void Test_MachineInfo(void)
+static void Test_MachineInfo(TestResults *r)
 {
-	results.ascVersion = ascReadReg(0x800);
-	results.isSonoraVersion = (results.ascVersion & 0xB0) == 0xB0;
-	results.boxFlag = *(uint8_t *)BoxFlag;
+	r->ascVersion = ascReadReg(0x800);
+	r->isSonoraVersion = (r->ascVersion & 0xB0) == 0xB0;
+	r->boxFlag = boxFlag();
 
 	long response;
 	OSErr err = Gestalt(gestaltSystemVersion, &response);
 	if (err == noErr)
 	{
-		results.sysVersion = response;
+		r->sysVersion = response;
+	}
+}
+
+// Sets up the microsecond timer the other tests use, and records how good it is
+static void Test_Timer(TestResults *r)
+{
+	TimingInit();
+	r->timerSource = TimingGetSource();
+	r->timerResolutionNs = TimingResolutionNs();
+	r->timerOverheadNs = TimingOverheadNs();
+}
+
+// Keeps the shortest time a calibration loop took, less the cost of the timestamps
+static void KeepFastest(uint32_t *fastestUs, uint32_t elapsedUs, uint32_t overheadUs)
+{
+	elapsedUs = (elapsedUs > overheadUs) ? elapsedUs - overheadUs : 0;
+	if (elapsedUs < *fastestUs)
+	{
+		*fastestUs = elapsedUs;
+	}
+}
+
+// Converts the time a calibration loop took to nanoseconds per iteration
+static uint32_t NsPerIteration(uint32_t us)
+{
+	return (uint32_t)(((uint64_t)us * 1000 + CALIBRATION_ITERATIONS / 2) / CALIBRATION_ITERATIONS);
+}
+
+// Measures how fast this CPU runs the loops that several results count iterations of,
+// so those counts can also be given in time. Each loop is short and runs with IRQs
+// disabled so nothing else gets in the way. The FIFO is put in the same mode
+// Test_FIFOIRQ uses, and is cleared out afterward.
+static void Test_CPUSpeed(TestResults *r)
+{
+	// Ticks can't time anything this short
+	if (r->timerSource == TimingSourceTicks)
+	{
+		return;
+	}
+
+	const bool mono = !r->shouldTestStereo;
+	const uint32_t overheadUs = (r->timerOverheadNs + 500) / 1000;
+	uint32_t nopUs = UINT32_MAX;
+	uint32_t readUs = UINT32_MAX;
+	uint32_t writeUs = UINT32_MAX;
+	uint32_t monoFillUs = UINT32_MAX;
+	uint32_t stereoFillUs = UINT32_MAX;
+
+	const uint16_t irqState = DisableIRQ();
+	const uint8_t originalMode = ascReadReg(0x801);
+	const uint8_t originalControl = ascReadReg(0x802);
+	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
+
+	via2WriteReg(0x1C13, 0x10);
+	ascWriteReg(0x801, 1);
+	if (mono)
+	{
+		ascWriteReg(0x802, originalControl & ~0x02);
+	}
+	else
+	{
+		ascWriteReg(0x802, originalControl | 0x02);
+	}
+
+	for (int run = 0; run < CALIBRATION_RUNS; run++)
+	{
+		uint32_t start = TimingNow();
+		for (int i = 0; i < CALIBRATION_ITERATIONS; i++)
+		{
+			nop();
+		}
+		KeepFastest(&nopUs, TimingNow() - start, overheadUs);
+
+		start = TimingNow();
+		for (int i = 0; i < CALIBRATION_ITERATIONS; i++)
+		{
+			(void)ascReadReg(0x800);
+		}
+		KeepFastest(&readUs, TimingNow() - start, overheadUs);
+
+		// Each of the loops that write samples starts with an empty FIFO and stays well
+		// short of filling it, so no write is dropped
+		ascWriteReg(0x803, 0x80);
+		ascWriteReg(0x803, 0);
+		start = TimingNow();
+		for (int i = 0; i < CALIBRATION_ITERATIONS; i++)
+		{
+			ascWriteReg(0x0, i & 0xFF);
+		}
+		KeepFastest(&writeUs, TimingNow() - start, overheadUs);
+
+		ascWriteReg(0x803, 0x80);
+		ascWriteReg(0x803, 0);
+		start = TimingNow();
+		for (int i = 0; i < CALIBRATION_ITERATIONS; i++)
+		{
+			ascWriteReg(0x0, i & 0xFF);
+			(void)ascReadReg(0x804);
+		}
+		KeepFastest(&monoFillUs, TimingNow() - start, overheadUs);
+
+		ascWriteReg(0x803, 0x80);
+		ascWriteReg(0x803, 0);
+		start = TimingNow();
+		for (int i = 0; i < CALIBRATION_ITERATIONS; i++)
+		{
+			ascWriteReg(0x0, i & 0xFF);
+			ascWriteReg(0x400, i & 0xFF);
+			(void)ascReadReg(0x804);
+		}
+		KeepFastest(&stereoFillUs, TimingNow() - start, overheadUs);
 	}
+
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+	(void)ascReadReg(0x804);
+	via2WriteReg(0x1A03, 0x90);
+	via2WriteReg(0x1C13, irqOriginallyEnabledInVIA2 ? 0x90 : 0x10);
+	ascWriteReg(0x802, originalControl);
+	ascWriteReg(0x801, originalMode);
+	RestoreIRQ(irqState);
+
+	r->cpuNopNs = NsPerIteration(nopUs);
+	r->cpuASCReadNs = NsPerIteration(readUs);
+	r->cpuFIFOWriteNs = NsPerIteration(writeUs);
+	r->cpuMonoFillNs = NsPerIteration(monoFillUs);
+	r->cpuStereoFillNs = NsPerIteration(stereoFillUs);
 }
 
 // Tests to see if registers $F09 and $F29 seem to exist
-static void Test_RegF09F29Exists(void)
+static void Test_RegF09F29Exists(TestResults *r)
 {
-	results.regF09Exists = true;
-	results.regF29Exists = true;
+	r->regF09Exists = true;
+	r->regF29Exists = true;
 
 	const uint16_t irqState = DisableIRQ();
 	const uint8_t originalF09 = ascReadReg(0xF09);
@@ -232,28 +350,28 @@ static void Test_RegF09F29Exists(void)
 	ascWriteReg(0xF09, 0x01);
 	if (ascReadReg(0xF09) != 0x01)
 	{
-		results.regF09Exists = false;
+		r->regF09Exists = false;
 	}
 	else
 	{
 		ascWriteReg(0xF09, 0x00);
 		if (ascReadReg(0xF09) != 0x00)
 		{
-			results.regF09Exists = false;
+			r->regF09Exists = false;
 		}
 	}
 
 	ascWriteReg(0xF29, 0x01);
 	if (ascReadReg(0xF29) != 0x01)
 	{
-		results.regF29Exists = false;
+		r->regF29Exists = false;
 	}
 	else
 	{
 		ascWriteReg(0xF29, 0x00);
 		if (ascReadReg(0xF29) != 0x00)
 		{
-			results.regF29Exists = false;
+			r->regF29Exists = false;
 		}
 	}
 
@@ -261,12 +379,12 @@ static void Test_RegF09F29Exists(void)
 	ascWriteReg(0xF29, originalF29);
 	RestoreIRQ(irqState);
 
-	results.regF09InitialValue = originalF09;
-	results.regF29InitialValue = originalF29;
+	r->regF09InitialValue = originalF09;
+	r->regF29InitialValue = originalF29;
 }
 
 // Tests what register $804 is at idle
-static void Test_Reg804Idle(void)
+static void Test_Reg804Idle(TestResults *r)
 {
 	const uint16_t irqState = DisableIRQ();
 	const uint8_t originalMode = ascReadReg(0x801);
@@ -274,63 +392,130 @@ static void Test_Reg804Idle(void)
 	ascWriteReg(0x801, 1);
 	// Read it once, then read again to see the "idle" status (some variants clear the bits after reading)
 	(void)ascReadReg(0x804);
-	results.reg804IdleValue = ascReadReg(0x804);
+	r->reg804IdleValue = ascReadReg(0x804);
 
 	ascWriteReg(0x801, originalMode);
 	RestoreIRQ(irqState);
 }
 
 // Tests to see if register $801 allows writing different values
-static void Test_ModeRegisterConfigurable(void)
+static void Test_ModeRegisterConfigurable(TestResults *r)
 {
 	const uint16_t irqState = DisableIRQ();
 	const uint8_t originalMode = ascReadReg(0x801);
 
 	// Try setting all 3 possible modes and seeing if the chip allows them
 	ascWriteReg(0x801, 0);
-	results.acceptsMode0 = (ascReadReg(0x801) == 0);
+	r->acceptsMode0 = (ascReadReg(0x801) == 0);
 	ascWriteReg(0x801, 1);
-	results.acceptsMode1 = (ascReadReg(0x801) == 1);
+	r->acceptsMode1 = (ascReadReg(0x801) == 1);
 	ascWriteReg(0x801, 2);
-	results.acceptsMode2 = (ascReadReg(0x801) == 2);
+	r->acceptsMode2 = (ascReadReg(0x801) == 2);
 
 	ascWriteReg(0x801, originalMode);
 	RestoreIRQ(irqState);
 
-	results.reg801InitialValue = originalMode;
+	r->reg801InitialValue = originalMode;
 }
 
 // Tests to see if the mono/stereo bit is writable in $802
-static void Test_MonoStereoConfigurable(void)
+static void Test_MonoStereoConfigurable(TestResults *r)
 {
 	const uint16_t irqState = DisableIRQ();
 	const uint8_t originalControl = ascReadReg(0x802);
 
 	// Check if we have control of the mono/stereo bit
 	ascWriteReg(0x802, ascReadReg(0x802) & ~0x02);
-	results.acceptsConfigMono = !(ascReadReg(0x802) & (1 << 1));
+	r->acceptsConfigMono = !(ascReadReg(0x802) & (1 << 1));
 	ascWriteReg(0x802, ascReadReg(0x802) | 0x02);
-	results.acceptsConfigStereo = ascReadReg(0x802) & (1 << 1);
+	r->acceptsConfigStereo = ascReadReg(0x802) & (1 << 1);
 
 	ascWriteReg(0x802, originalControl);
 	RestoreIRQ(irqState);
 
 	// What we should actually test doesn't always match this bit.
 	// Case in point: Sonora leaves the mono/stereo bit as 0, but it's really stereo.
-	results.shouldTestMono = results.acceptsConfigMono && !results.isSonoraVersion;
-	results.shouldTestStereo = results.acceptsConfigStereo || results.isSonoraVersion;
+	r->shouldTestMono = r->acceptsConfigMono && !r->isSonoraVersion;
+	r->shouldTestStereo = r->acceptsConfigStereo || r->isSonoraVersion;
+}
+
+// Writes a sample to FIFO A, and to FIFO B too in stereo. The mode is a template
+// parameter so each loop that writes samples is built once per mode, with no check
+// of the mode inside it; the tests pick the right version once, before they start.
+template <bool stereo>
+static inline void WriteSample(uint8_t sample)
+{
+	ascWriteReg(0x0, sample);
+	if (stereo)
+	{
+		ascWriteReg(0x400, sample);
+	}
+}
+
+// The two status bits of FIFO A or B in a value of register $804
+template <bool fifoA>
+static inline uint8_t FIFOStatusBits(uint8_t status)
+{
+	return (fifoA ? status : (status >> 2)) & 0x03;
+}
+
+// Writes the given number of samples
+template <bool stereo>
+static void WriteSamples(int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		WriteSample<stereo>(i & 0xFF);
+	}
+}
+
+// Writes up to 0x1000 samples, noting when the FIFO A and B full bits turn on
+template <bool stereo>
+static void FillUntilFull(FIFOTestResults *f)
+{
+	for (int i = 0; i < 0x1000; i++)
+	{
+		WriteSample<stereo>(i & 0xFF);
+		const uint8_t irqState = ascReadReg(0x804);
+		if ((irqState & 0x02) && !f->aReachesFull)
+		{
+			f->aReachesFull = true;
+			f->aFullCount = i + 0x101;
+			if (!(irqState & 0x01))
+			{
+				f->aHalfEmptyIsOffWhenFull = true;
+			}
+
+		}
+		if ((irqState & 0x08) && !f->bReachesFull)
+		{
+			f->bReachesFull = true;
+			f->bFullCount = i + 0x101;
+			if (!(irqState & 0x04))
+			{
+				f->bHalfEmptyIsOffWhenFull = true;
+			}
+		}
+
+		// If we have nothing left to check flags on, we're good.
+		if ((f->aFullTooSoon || f->aReachesFull) &&
+			(f->bFullTooSoon || f->bReachesFull))
+		{
+			break;
+		}
+	}
 }
 
 // Extensively tests the FIFO in mono or stereo mode, checks to see if the
 // FIFO status bits react as expected. No IRQs involved yet.
-static void Test_FIFOFullHalfFullEmpty(bool mono, FIFOTestResults *f)
+static void Test_FIFOFullHalfFullEmpty(TestResults *r, bool mono, FIFOTestResults *f)
 {
 	uint16_t irqState = DisableIRQ();
 	const uint8_t originalMode = ascReadReg(0x801);
 	const uint8_t originalControl = ascReadReg(0x802);
 	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
-	const uint8_t originalF09Value = results.regF09Exists ? ascReadReg(0xF09) : 0;
-	const uint8_t originalF29Value = results.regF29Exists ? ascReadReg(0xF29) : 0;
+	const uint8_t originalF09Value = r->regF09Exists ? ascReadReg(0xF09) : 0;
+	const uint8_t originalF29Value = r->regF29Exists ? ascReadReg(0xF29) : 0;
 
 	// Put in FIFO mode, mono or stereo
 	ascWriteReg(0x801, 1);
@@ -347,11 +532,11 @@ static void Test_FIFOFullHalfFullEmpty(bool mono, FIFOTestResults *f)
 	ascWriteReg(0x803, 0);
 	// Make sure the ASC IRQ is disabled in VIA2 and F09/F29
 	via2WriteReg(0x1C13, 0x10);
-	if (results.regF09Exists)
+	if (r->regF09Exists)
 	{
 		ascWriteReg(0xF09, 1);
 	}
-	if (results.regF29Exists)
+	if (r->regF29Exists)
 	{
 		ascWriteReg(0xF29, 1);
 	}
@@ -363,14 +548,13 @@ static void Test_FIFOFullHalfFullEmpty(bool mono, FIFOTestResults *f)
 	(void)ascReadReg(0x804);
 
 	// Prime it with 0x100 samples to begin
-	for (int i = 0; i < 0x100; i++)
+	if (mono)
 	{
-		const uint8_t nextSample = (i & 0xFF);
-		ascWriteReg(0x0, nextSample);
-		if (!mono)
-		{
-			ascWriteReg(0x400, nextSample);
-		}
+		WriteSamples<false>(0x100);
+	}
+	else
+	{
+		WriteSamples<true>(0x100);
 	}
 
 	// Check the state of the bits now; make sure they don't indicate the FIFO is full/empty.
@@ -383,41 +567,13 @@ static void Test_FIFOFullHalfFullEmpty(bool mono, FIFOTestResults *f)
 	// write up to 0x1000 additional samples (maybe fewer if we figure out what we need to know)
 	if (!f->aFullTooSoon || !f->bFullTooSoon)
 	{
-		for (int i = 0; i < 0x1000; i++)
+		if (mono)
 		{
-			const uint8_t nextSample = (i & 0xFF);
-			ascWriteReg(0x0, nextSample);
-			if (!mono)
-			{
-				ascWriteReg(0x400, nextSample);
-			}
-			const uint8_t irqState = ascReadReg(0x804);
-			if ((irqState & 0x02) && !f->aReachesFull)
-			{
-				f->aReachesFull = true;
-				f->aFullCount = i + 0x101;
-				if (!(irqState & 0x01))
-				{
-					f->aHalfEmptyIsOffWhenFull = true;
-				}
-
-			}
-			if ((irqState & 0x08) && !f->bReachesFull)
-			{
-				f->bReachesFull = true;
-				f->bFullCount = i + 0x101;
-				if (!(irqState & 0x04))
-				{
-					f->bHalfEmptyIsOffWhenFull = true;
-				}
-			}
-
-			// If we have nothing left to check flags on, we're good.
-			if ((f->aFullTooSoon || f->aReachesFull) &&
-				(f->bFullTooSoon || f->bReachesFull))
-			{
-				break;
-			}
+			FillUntilFull<false>(f);
+		}
+		else
+		{
+			FillUntilFull<true>(f);
 		}
 	}
 
@@ -427,7 +583,7 @@ static void Test_FIFOFullHalfFullEmpty(bool mono, FIFOTestResults *f)
 		f->bHalfEmptyIsOffWhenFull)
 	{
 		const uint32_t startTicks = ticks();
-		while (ticks() - startTicks < 60*1)
+		while (!ticksElapsed(startTicks, 60*1))
 		{
 			const uint8_t irqState = ascReadReg(0x804);
 			if (irqState & 0x01)
@@ -461,7 +617,7 @@ static void Test_FIFOFullHalfFullEmpty(bool mono, FIFOTestResults *f)
 		f->bEmptyIsOffWhenHalfEmpty)
 	{
 		const uint32_t startTicks = ticks();
-		while (ticks() - startTicks < 60*1)
+		while (!ticksElapsed(startTicks, 60*1))
 		{
 			const uint8_t irqState = ascReadReg(0x804);
 			if (irqState & 0x02)
@@ -493,11 +649,11 @@ static void Test_FIFOFullHalfFullEmpty(bool mono, FIFOTestResults *f)
 	}
 
 	irqState = DisableIRQ();
-	if (results.regF09Exists)
+	if (r->regF09Exists)
 	{
 		ascWriteReg(0xF09, originalF09Value);
 	}
-	if (results.regF29Exists)
+	if (r->regF29Exists)
 	{
 		ascWriteReg(0xF29, originalF29Value);
 	}
@@ -508,33 +664,35 @@ static void Test_FIFOFullHalfFullEmpty(bool mono, FIFOTestResults *f)
 }
 
 // Tests the FIFO in mono mode (if allowed)
-static void Test_FIFOFullHalfFullEmpty_Mono(void)
+static void Test_FIFOFullHalfFullEmpty_Mono(TestResults *r)
 {
 	// Only do this test if we have deemed that we should test mono mode
-	if (!results.shouldTestMono)
+	if (!r->shouldTestMono)
 	{
 		return;
 	}
 
-	Test_FIFOFullHalfFullEmpty(true, &results.monoFIFO);
+	Test_FIFOFullHalfFullEmpty(r, true, &r->monoFIFO);
 }
 
 // Tests the FIFO in stereo mode (if allowed)
-static void Test_FIFOFullHalfFullEmpty_Stereo(void)
+static void Test_FIFOFullHalfFullEmpty_Stereo(TestResults *r)
 {
 	// Only do this test if we saw that it accepted stereo mode
 	// Exception: Sonora doesn't accept stereo mode but is really always stereo
-	if (!results.acceptsConfigStereo && ((results.ascVersion & 0xF0) != 0xB0))
+	if (!r->acceptsConfigStereo && ((r->ascVersion & 0xF0) != 0xB0))
 	{
 		return;
 	}
 
-	Test_FIFOFullHalfFullEmpty(false, &results.stereoFIFO);
+	Test_FIFOFullHalfFullEmpty(r, false, &r->stereoFIFO);
 }
 
 // Tests how often VIA2's address space repeats
-static void Test_VIA2Repeat(void)
+static void Test_VIA2Repeat(TestResults *r)
 {
+	union TempBuffer buf;
+	union TempBuffer buf2;
 	const uint16_t irqState = DisableIRQ();
 
 	// Read the first 0x200 bytes of VIA2.
@@ -543,12 +701,11 @@ static void Test_VIA2Repeat(void)
 	bool consistentReadback = false;
 	for (int i = 0; !consistentReadback && i < 1000; i++)
 	{
-		uint32_t *readLoc = *(uint32_t **)VIA2Base;
 		TempBuffer *destBuf = (i & 1) ? &buf : &buf2;
 
 		for (int j = 0; j < 0x80; j++)
 		{
-			destBuf->words[j] = *readLoc++;
+			destBuf->words[j] = via2ReadLong(j * 4);
 		}
 
 		if (i > 0)
@@ -559,7 +716,7 @@ static void Test_VIA2Repeat(void)
 			}
 		}
 	}
-	results.via2ReadbackConsistent = consistentReadback;
+	r->via2ReadbackConsistent = consistentReadback;
 
 	RestoreIRQ(irqState);
 
@@ -585,18 +742,18 @@ static void Test_VIA2Repeat(void)
 		}
 	}
 
-	results.via2AddressDecodeMask = decodeMask;
+	r->via2AddressDecodeMask = decodeMask;
 }
 
 // Tests whether the VIA2 mirroring works (whether you can use $1C13 instead of
 // $1C00 or $13 depending on the variant)
-static void Test_VIA2Mirror(void)
+static void Test_VIA2Mirror(TestResults *r)
 {
 	const uint16_t irqState = DisableIRQ();
 	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
 	bool ok = true;
 
-	const uint16_t actualOffset = (results.via2AddressDecodeMask == 0) ?
+	const uint16_t actualOffset = (r->via2AddressDecodeMask == 0) ?
 		0x1C00 : 0x13;
 
 	// Confirm that writes to 0x1C13 apply to 0x1C00 or 0x13, depending on this machine's VIA2 setup
@@ -638,7 +795,7 @@ static void Test_VIA2Mirror(void)
 	// Clear any active IRQs just in case
 	via2WriteReg(0x1A03, 0x90);
 
-	results.via2MirroringOK = ok;
+	r->via2MirroringOK = ok;
 
 	RestoreIRQ(irqState);
 }
@@ -646,7 +803,71 @@ static void Test_VIA2Mirror(void)
 // Gets pointer to test results struct from IRQ context
 static TestResults *resultsFromIRQ(void)
 {
-	return *(TestResults **)ApplScratch;
+	return *(TestResults **)applScratch();
+}
+
+// Counts an IRQ, and returns true if it confirms a flood: the IRQs have kept coming in
+// at a flood rate for long enough, or there have been IRQ_FLOOD_TEST_COUNT of them.
+// The count is then set to IRQ_FLOOD_TEST_COUNT and the rate saved. Each count being
+// checked has its own windows; only the first IRQ of a window is timed, so the handler
+// stays quick.
+static bool CountIRQ(TestResults *r, volatile uint32_t *count, int window)
+{
+	IRQFloodWindow *w = &r->tmpIRQFloodWindows[window];
+	const uint32_t n = ++*count;
+	bool flood = n >= IRQ_FLOOD_TEST_COUNT;
+
+	if (n > IRQ_FLOOD_TIMED_AFTER && (n - IRQ_FLOOD_TIMED_AFTER) % IRQ_FLOOD_WINDOW == 1)
+	{
+		const uint32_t now = TimingNow();
+		if (n > IRQ_FLOOD_TIMED_AFTER + 1)
+		{
+			if (IRQ_FLOOD_WINDOW * 1000000UL > IRQ_FLOOD_RATE * (uint64_t)(now - w->boundaryUs))
+			{
+				if (!w->running)
+				{
+					w->running = true;
+					w->runStartUs = w->boundaryUs;
+					w->runIRQs = 0;
+				}
+				w->runIRQs += IRQ_FLOOD_WINDOW;
+				if (now - w->runStartUs >= IRQ_FLOOD_MIN_US)
+				{
+					r->tmpIRQFloodRate = (uint32_t)((uint64_t)w->runIRQs * 1000000 / (now - w->runStartUs));
+					flood = true;
+				}
+			}
+			else
+			{
+				w->running = false;
+			}
+		}
+		w->boundaryUs = now;
+	}
+
+	if (flood)
+	{
+		*count = IRQ_FLOOD_TEST_COUNT;
+		r->tmpIRQFlooded = true;
+	}
+	return flood;
+}
+
+// Starts counting IRQs for flood detection from scratch
+static void ResetIRQFloodDetection(TestResults *r)
+{
+	r->tmpIRQFlooded = false;
+	r->tmpIRQFloodRate = 0;
+	memset(r->tmpIRQFloodWindows, 0, sizeof(r->tmpIRQFloodWindows));
+}
+
+// Waits for the given number of ticks, or until an IRQ flood has been confirmed
+static void WaitTicksUnlessFlooded(const TestResults *r, uint32_t count)
+{
+	const uint32_t startTicks = ticks();
+	while (!r->tmpIRQFlooded && !ticksElapsed(startTicks, count))
+	{
+	}
 }
 
 // IRQ handler used for idle testing
@@ -658,18 +879,16 @@ static void Test_IdleIRQHandler(void)
 	// Acknowledge the IRQ
 	via2WriteReg(0x1A03, 0x90);
 
+	// Safety: if the idle IRQs flood, disable them
 	TestResults *r = resultsFromIRQ();
-	r->tmpIRQCount++;
-
-	// Safety: if we get too many idle IRQs, disable it
-	if (r->tmpIRQCount >= IRQ_FLOOD_TEST_COUNT)
+	if (CountIRQ(r, &r->tmpIRQCount, 0))
 	{
 		via2WriteReg(0x1C13, 0x10);
 	}
 }
 
 // Tests to see if the ASC floods IRQs while idle
-static void Test_IdleIRQ(bool hasF09, bool hasF29, bool enableF29)
+static void Test_IdleIRQ(TestResults *r, bool hasF09, bool hasF29, bool enableF29)
 {
 	uint16_t irqState = DisableIRQ();
 	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
@@ -677,8 +896,9 @@ static void Test_IdleIRQ(bool hasF09, bool hasF29, bool enableF29)
 	const uint8_t originalF29Value = hasF29 ? ascReadReg(0xF29) : 0;
 	VIA2Handler originalASCIRQHandler = via2Handlers()[4];
 
-	*(TestResults **)ApplScratch = &results;
-	results.tmpIRQCount = 0;
+	*(TestResults **)applScratch() = r;
+	r->tmpIRQCount = 0;
+	ResetIRQFloodDetection(r);
 	via2Handlers()[4] = Test_IdleIRQHandler;
 	via2WriteReg(0x1C13, 0x90);
 	via2WriteReg(0x1A03, 0x90); // Acknowledge anything already waiting
@@ -694,89 +914,87 @@ static void Test_IdleIRQ(bool hasF09, bool hasF29, bool enableF29)
 
 	RestoreIRQ(irqState);
 	// Immediately read the IRQ count to see how far we get
-	results.irqCountTest = results.tmpIRQCount;
+	r->irqCountTest = r->tmpIRQCount;
 
-	// Wait for 2 seconds
-	const uint32_t startTicks = ticks();
-	while (ticks() - startTicks < 60*2)
-	{
-	}
+	// Wait for 2 seconds, or until it's clear it floods
+	WaitTicksUnlessFlooded(r, 60*2);
 
 	irqState = DisableIRQ();
 
 	// See if we got any IRQs
-	if (results.tmpIRQCount > 0)
+	if (r->tmpIRQCount > 0)
 	{
 		if (enableF29)
 		{
-			results.idleIRQWithF29 = true;
+			r->idleIRQWithF29 = true;
 		}
 		else
 		{
-			results.idleIRQWithoutF29 = true;
+			r->idleIRQWithoutF29 = true;
 		}
 	}
 
 	// Look to see if we had to disable the IRQ due to flooding
-	if (results.tmpIRQCount >= IRQ_FLOOD_TEST_COUNT)
+	if (r->tmpIRQCount >= IRQ_FLOOD_TEST_COUNT)
 	{
 		if (enableF29)
 		{
-			results.floodsIRQWithF29 = true;
-			if (results.irqCountTest >= IRQ_FLOOD_TEST_COUNT)
+			r->floodsIRQWithF29 = true;
+			if (r->irqCountTest >= IRQ_FLOOD_TEST_COUNT)
 			{
-				results.irqFloodWithF29TakesOverCPU = true;
+				r->irqFloodWithF29TakesOverCPU = true;
 			}
 		}
 		else
 		{
-			results.floodsIRQWithoutF29 = true;
-			if (results.irqCountTest >= IRQ_FLOOD_TEST_COUNT)
+			r->floodsIRQWithoutF29 = true;
+			if (r->irqCountTest >= IRQ_FLOOD_TEST_COUNT)
 			{
-				results.irqFloodWithoutF29TakesOverCPU = true;
+				r->irqFloodWithoutF29TakesOverCPU = true;
 			}
 		}
 	}
 
 	if (enableF29)
 	{
-		results.idleIRQWithF29Count = results.tmpIRQCount;
+		r->idleIRQWithF29Count = r->tmpIRQCount;
+		r->idleIRQWithF29FloodRate = r->tmpIRQFloodRate;
 	}
 	else
 	{
-		results.idleIRQWithoutF29Count = results.tmpIRQCount;
+		r->idleIRQWithoutF29Count = r->tmpIRQCount;
+		r->idleIRQWithoutF29FloodRate = r->tmpIRQFloodRate;
 	}
 
 	// If we are in the F29 test, try toggling it to 1 and 0 again to see if it re-fires
 	if (hasF29 && enableF29)
 	{
-		results.tmpIRQCount = 0;
+		r->tmpIRQCount = 0;
+		ResetIRQFloodDetection(r);
 		via2WriteReg(0x1C13, 0x90); // If it flooded the first time, we need to re-enable it
 		ascWriteReg(0xF29, 1);
 		ascWriteReg(0xF29, 0);
 		RestoreIRQ(irqState);
 		// Immediately read the IRQ count to see how far we get
-		results.irqCountTest = results.tmpIRQCount;
+		r->irqCountTest = r->tmpIRQCount;
 
-		// Wait for 2 seconds and then clear it again
-		const uint32_t startTicks = ticks();
-		while (ticks() - startTicks < 60*2)
-		{
-		}
+		// Wait for 2 seconds (or until it floods) and then clear it again
+		WaitTicksUnlessFlooded(r, 60*2);
 
 		irqState = DisableIRQ();
 
 		// See if re-enabling the IRQ re-fired it and if it flooded again
-		if (results.tmpIRQCount > 0)
+		if (r->tmpIRQCount > 0)
 		{
-			results.refiresIdleIRQWithF29 = true;
+			r->refiresIdleIRQWithF29 = true;
 		}
-		if (results.tmpIRQCount >= IRQ_FLOOD_TEST_COUNT)
+		r->idleIRQRefireWithF29FloodRate = r->tmpIRQFloodRate;
+		if (r->tmpIRQCount >= IRQ_FLOOD_TEST_COUNT)
 		{
-			results.refiresIdleIRQFloodWithF29 = true;
-			if (results.irqCountTest >= IRQ_FLOOD_TEST_COUNT)
+			r->refiresIdleIRQFloodWithF29 = true;
+			if (r->irqCountTest >= IRQ_FLOOD_TEST_COUNT)
 			{
-				results.irqFloodRefireWithF29TakesOverCPU = true;
+				r->irqFloodRefireWithF29TakesOverCPU = true;
 			}
 		}
 	}
@@ -802,115 +1020,122 @@ static void Test_IdleIRQ(bool hasF09, bool hasF29, bool enableF29)
 }
 
 // Tests to see if IRQs flood at idle without reg $F29
-static void Test_IdleIRQWithoutF29(void)
+static void Test_IdleIRQWithoutF29(TestResults *r)
 {
-	Test_IdleIRQ(results.regF09Exists, results.regF29Exists, false);
+	Test_IdleIRQ(r, r->regF09Exists, r->regF29Exists, false);
 }
 
 // Tests to see if IRQs flood at idle with reg $F29 = 0 (if it exists)
-static void Test_IdleIRQWithF29(void)
+static void Test_IdleIRQWithF29(TestResults *r)
 {
-	if (results.regF29Exists)
+	if (r->regF29Exists)
 	{
-		Test_IdleIRQ(results.regF09Exists, results.regF29Exists, true);
+		Test_IdleIRQ(r, r->regF09Exists, r->regF29Exists, true);
 	}
 }
 
-// IRQ handler used for testing the FIFO IRQ
+// IRQ handler used for testing the FIFO IRQ, built for FIFO A or B status bits
+template <bool fifoA>
 static void Test_FIFOIRQHandler(void)
 {
 	// Acknowledge the IRQ
 	via2WriteReg(0x1A03, 0x90);
 
-	// Read the status reg
-	uint8_t status = ascReadReg(0x804);
+	// Read the status reg, looking only at the bits of the FIFO we care about
+	const uint8_t status = FIFOStatusBits<fifoA>(ascReadReg(0x804));
 
-	// Shift it over if we're looking at FIFO B
 	TestResults *r = resultsFromIRQ();
-	if (!r->fifoIRQTestedWasA)
-	{
-		status >>= 2;
-	}
-	// Mask so we only look at the bits we care about
-	status &= 0x03;
 
-	bool irqFlood = false;
+	bool irqFlood;
 
 	if (status == 0x02)
 	{
-		if (++r->fullIRQCount >= IRQ_FLOOD_TEST_COUNT)
-		{
-			irqFlood = true;
-		}
+		irqFlood = CountIRQ(r, &r->fullIRQCount, 0);
 	}
 	else if (status == 0x01)
 	{
-		if (++r->halfEmptyIRQCount >= IRQ_FLOOD_TEST_COUNT)
-		{
-			irqFlood = true;
-		}
+		irqFlood = CountIRQ(r, &r->halfEmptyIRQCount, 1);
 	}
 	else if (status == 0x03)
 	{
-		if (++r->emptyIRQCount >= IRQ_FLOOD_TEST_COUNT)
-		{
-			irqFlood = true;
-		}
+		irqFlood = CountIRQ(r, &r->emptyIRQCount, 2);
 	}
 	else
 	{
-		if (++r->otherIRQCount >= IRQ_FLOOD_TEST_COUNT)
-		{
-			irqFlood = true;
-		}
+		irqFlood = CountIRQ(r, &r->otherIRQCount, 3);
 	}
 
-	// Safety: if we get too many IRQs, disable it
+	// Safety: if the IRQs flood, disable them
 	if (irqFlood)
 	{
 		via2WriteReg(0x1C13, 0x10);
 	}
 }
 
-// Tests the FIFO again, this time seeing which IRQs activate
-static void Test_FIFOIRQ(void)
+// Writes up to 0x1000 samples, stopping when the IRQ handler sees that the FIFO is
+// full. That won't happen if the ASC doesn't interrupt on FIFO full; we already know
+// the FIFO full bit works because we tested it earlier.
+template <bool stereo>
+static void FillUntilFullIRQ(const TestResults *r)
 {
-	// Only use mono if stereo isn't supported by this variant
-	const bool mono = !results.shouldTestStereo;
-	const bool enableF29 = results.regF29Exists;
-	const FIFOTestResults *f = mono ? &results.monoFIFO : &results.stereoFIFO;
+	for (int i = 0; i < 0x1000; i++)
+	{
+		WriteSample<stereo>(i & 0xFF);
+		if (r->fullIRQCount > 0)
+		{
+			break;
+		}
+	}
+}
 
-	// Based on our earlier tests, see if we can actually run this test.
+// Based on the polling tests in one mode, picks which FIFO's status bits to go by when
+// testing IRQs in that mode. Returns false if neither worked well enough.
+static bool PickIRQStatusFIFO(const FIFOTestResults *f, bool *fifoA)
+{
 	// Prefer checking FIFO B bits because it's what Sonora uses, and it makes
 	// sense to check them in stereo mode too
 	if (!f->bFullTooSoon && f->bReachesFull && f->bHalfEmptyIsOffWhenFull &&
 		f->bHalfEmptyTurnsOn && f->bEmptyIsOffWhenHalfEmpty)
 	{
-		results.fifoIRQTestedWasA = false;
-		results.testedFIFOIRQs = true;
+		*fifoA = false;
+		return true;
 	}
 	else if (!f->aFullTooSoon && f->aReachesFull && f->aHalfEmptyIsOffWhenFull &&
 		f->aHalfEmptyTurnsOn && f->aEmptyIsOffWhenHalfEmpty)
 	{
-		results.fifoIRQTestedWasA = true;
-		results.testedFIFOIRQs = true;
+		*fifoA = true;
+		return true;
 	}
-	else
+	return false;
+}
+
+// Tests the FIFO again, this time seeing which IRQs activate
+static void Test_FIFOIRQ(TestResults *r)
+{
+	// Only use mono if stereo isn't supported by this variant
+	const bool mono = !r->shouldTestStereo;
+	const bool enableF29 = r->regF29Exists;
+	const FIFOTestResults *f = mono ? &r->monoFIFO : &r->stereoFIFO;
+
+	// Based on our earlier tests, see if we can actually run this test
+	if (!PickIRQStatusFIFO(f, &r->fifoIRQTestedWasA))
 	{
 		// We didn't observe a working FIFO without the IRQs, so don't bother trying to
 		// test with IRQs
 		return;
 	}
+	r->testedFIFOIRQs = true;
 
 	uint16_t irqState = DisableIRQ();
 	const uint8_t originalMode = ascReadReg(0x801);
 	const uint8_t originalControl = ascReadReg(0x802);
 	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
-	const uint8_t originalF09Value = results.regF09Exists ? ascReadReg(0xF09) : 0;
+	const uint8_t originalF09Value = r->regF09Exists ? ascReadReg(0xF09) : 0;
 	const uint8_t originalF29Value = enableF29 ? ascReadReg(0xF29) : 0;
 	VIA2Handler originalASCIRQHandler = via2Handlers()[4];
-	*(TestResults **)ApplScratch = &results;
-	via2Handlers()[4] = Test_FIFOIRQHandler;
+	*(TestResults **)applScratch() = r;
+	ResetIRQFloodDetection(r);
+	via2Handlers()[4] = r->fifoIRQTestedWasA ? Test_FIFOIRQHandler<true> : Test_FIFOIRQHandler<false>;
 
 	// Put in FIFO mode, mono or stereo
 	ascWriteReg(0x801, 1);
@@ -927,19 +1152,18 @@ static void Test_FIFOIRQ(void)
 	(void)ascReadReg(0x804);
 
 	// Keep filling the FIFO until it is more than half full
-	for (int i = 0; i < 0x300; i++)
+	if (mono)
 	{
-		const uint8_t nextSample = (i & 0xFF);
-		ascWriteReg(0x0, nextSample);
-		if (!mono)
-		{
-			ascWriteReg(0x400, nextSample);
-		}
+		WriteSamples<false>(0x300);
+	}
+	else
+	{
+		WriteSamples<true>(0x300);
 	}
 
 	// Turn on IRQs after it's more than half full
 	via2WriteReg(0x1C13, 0x90);
-	if (results.regF09Exists)
+	if (r->regF09Exists)
 	{
 		// Leave F09 disabled; on newer variants it's related to recording instead of playback.
 		ascWriteReg(0xF09, 1);
@@ -951,35 +1175,27 @@ static void Test_FIFOIRQ(void)
 	RestoreIRQ(irqState);
 
 	// Keep filling the FIFO for a while, let's see if we ever get an IRQ
-	for (int i = 0; i < 0x1000; i++)
+	if (mono)
 	{
-		const uint8_t nextSample = (i & 0xFF);
-		ascWriteReg(0x0, nextSample);
-		if (!mono)
-		{
-			ascWriteReg(0x400, nextSample);
-		}
-
-		// The handler will tell us if the FIFO is full, unless the ASC doesn't
-		// interrupt on FIFO full. We already know the FIFO full bit works because
-		// we tested it earlier.
-		if (results.fullIRQCount > 0)
-		{
-			break;
-		}
+		FillUntilFullIRQ<false>(r);
+	}
+	else
+	{
+		FillUntilFullIRQ<true>(r);
 	}
 
 	// Make sure we haven't received a half empty or empty IRQ yet. It hasn't had enough time to empty out.
-	if (results.halfEmptyIRQCount > 0)
+	if (r->halfEmptyIRQCount > 0)
 	{
-		results.gotIRQOnFIFOHalfEmptyTooSoon = true;
+		r->gotIRQOnFIFOHalfEmptyTooSoon = true;
 	}
-	if (results.emptyIRQCount > 0)
+	if (r->emptyIRQCount > 0)
 	{
-		results.gotIRQOnFIFOEmptyTooSoon = true;
+		r->gotIRQOnFIFOEmptyTooSoon = true;
 	}
 
-	// Now stop and wait 4 seconds for the FIFO to empty out, see what types of IRQs we get
+	// Now stop and wait 4 seconds for the FIFO to empty out, see what types of IRQs we get.
+	// If they flood, the handler disables them, so there's no point waiting any longer.
 	uint32_t maxDiffFull = 0;
 	uint32_t maxDiffHalf = 0;
 	uint32_t maxDiffEmpty = 0;
@@ -988,14 +1204,20 @@ static void Test_FIFOIRQ(void)
 	uint32_t lastHalf = 0;
 	uint32_t lastEmpty = 0;
 	uint32_t lastOther = 0;
+	uint32_t pollLoops = 0;
 	const uint32_t startTicks = ticks();
-	while (ticks() - startTicks < 60*4)
+	while (!ticksElapsed(startTicks, 60*4))
 	{
+		pollLoops++;
+
+		// Once a flood is seen, the counts don't change any more, so this is the last time
+		const bool flooded = r->tmpIRQFlooded;
+
 		// Sample the four counters that the IRQ will increment
-		const uint32_t newFull = results.fullIRQCount;
-		const uint32_t newHalf = results.halfEmptyIRQCount;
-		const uint32_t newEmpty = results.emptyIRQCount;
-		const uint32_t newOther = results.otherIRQCount;
+		const uint32_t newFull = r->fullIRQCount;
+		const uint32_t newHalf = r->halfEmptyIRQCount;
+		const uint32_t newEmpty = r->emptyIRQCount;
+		const uint32_t newOther = r->otherIRQCount;
 
 		// Calculate the maximum differences we observe while waiting
 		uint32_t diff = newFull - lastFull;
@@ -1023,11 +1245,16 @@ static void Test_FIFOIRQ(void)
 		lastHalf = newHalf;
 		lastEmpty = newEmpty;
 		lastOther = newOther;
+
+		if (flooded)
+		{
+			break;
+		}
 	}
 
 	irqState = DisableIRQ();
 	via2Handlers()[4] = originalASCIRQHandler;
-	if (results.regF09Exists)
+	if (r->regF09Exists)
 	{
 		ascWriteReg(0xF09, originalF09Value);
 	}
@@ -1042,10 +1269,12 @@ static void Test_FIFOIRQ(void)
 	RestoreIRQ(irqState);
 
 	// Save max differences we observed
-	results.fullIRQMaxDiff = maxDiffFull;
-	results.halfEmptyIRQMaxDiff = maxDiffHalf;
-	results.emptyIRQMaxDiff = maxDiffEmpty;
-	results.otherIRQMaxDiff = maxDiffOther;
+	r->fullIRQMaxDiff = maxDiffFull;
+	r->halfEmptyIRQMaxDiff = maxDiffHalf;
+	r->emptyIRQMaxDiff = maxDiffEmpty;
+	r->otherIRQMaxDiff = maxDiffOther;
+	r->fifoIRQPollLoops = pollLoops;
+	r->fifoIRQFloodRate = r->tmpIRQFloodRate;
 }
 
 static void Test_FIFOIRQ_WhileFullHandler(void)
@@ -1063,28 +1292,51 @@ static void Test_FIFOIRQ_WhileFullHandler(void)
 	via2WriteReg(0x1C13, 0x10);
 }
 
+// Writes up to 0x1000 samples, stopping when the status bits of the FIFO being
+// watched say it's full
+template <bool stereo, bool fifoA>
+static void FillUntilFullStatus(void)
+{
+	for (int i = 0; i < 0x1000; i++)
+	{
+		WriteSample<stereo>(i & 0xFF);
+
+		// We filled up!
+		if (FIFOStatusBits<fifoA>(ascReadReg(0x804)) == 0x02)
+		{
+			break;
+		}
+	}
+}
+
+// FillUntilFullStatus for each mode (mono, stereo) and FIFO (B, A)
+static void (*const fillUntilFullStatus[2][2])(void) =
+{
+	{ FillUntilFullStatus<false, false>, FillUntilFullStatus<false, true> },
+	{ FillUntilFullStatus<true, false>, FillUntilFullStatus<true, true> },
+};
+
 // Tests to see if an IRQ fires immediately if we quickly enable and disable the IRQ while it's full.
 // Determines if enabling the IRQ causes it to fire immediately if no IRQ condition is active.
 // Uses F29 if it exists; otherwise uses VIA2
-static void Test_FIFOIRQ_WhileFull(void)
+static void Test_FIFOIRQ_WhileFull(TestResults *r)
 {
-	if (!results.testedFIFOIRQs)
+	if (!r->testedFIFOIRQs)
 	{
 		return;
 	}
 
 	// Only use mono if stereo isn't supported by this variant
-	const bool mono = !results.shouldTestStereo;
-	const FIFOTestResults *f = mono ? &results.monoFIFO : &results.stereoFIFO;
+	const bool mono = !r->shouldTestStereo;
 
 	uint16_t irqState = DisableIRQ();
 	const uint8_t originalMode = ascReadReg(0x801);
 	const uint8_t originalControl = ascReadReg(0x802);
 	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
-	const uint8_t originalF09Value = results.regF09Exists ? ascReadReg(0xF09) : 0;
-	const uint8_t originalF29Value = results.regF29Exists ? ascReadReg(0xF29) : 0;
+	const uint8_t originalF09Value = r->regF09Exists ? ascReadReg(0xF09) : 0;
+	const uint8_t originalF29Value = r->regF29Exists ? ascReadReg(0xF29) : 0;
 	VIA2Handler originalASCIRQHandler = via2Handlers()[4];
-	*(TestResults **)ApplScratch = &results;
+	*(TestResults **)applScratch() = r;
 	via2Handlers()[4] = Test_FIFOIRQ_WhileFullHandler;
 
 	// Put in FIFO mode, mono or stereo
@@ -1102,68 +1354,50 @@ static void Test_FIFOIRQ_WhileFull(void)
 	(void)ascReadReg(0x804);
 
 	// Keep filling the FIFO until it is full
-	for (int i = 0; i < 0x1000; i++)
-	{
-		const uint8_t nextSample = (i & 0xFF);
-		ascWriteReg(0x0, nextSample);
-		if (!mono)
-		{
-			ascWriteReg(0x400, nextSample);
-		}
-
-		uint8_t status = ascReadReg(0x804);
-		if (!results.fifoIRQTestedWasA)
-		{
-			status >>= 2;
-		}
-		status &= 0x03;
-
-		// We filled up!
-		if (status == 0x02)
-		{
-			break;
-		}
-	}
+	fillUntilFullStatus[!mono][r->fifoIRQTestedWasA]();
 
 	// Turn on IRQs after it's full
 	via2WriteReg(0x1C13, 0x90);
-	if (results.regF09Exists)
+	if (r->regF09Exists)
 	{
 		// Leave F09 disabled; on newer variants it's related to recording instead of playback.
 		ascWriteReg(0xF09, 1);
 	}
-	if (results.regF29Exists)
+	if (r->regF29Exists)
 	{
 		ascWriteReg(0xF29, 0);
 	}
 	RestoreIRQ(irqState);
 
 	// Toggle the IRQ off and back on one more time
-	if (results.regF29Exists)
+	if (r->regF29Exists)
 	{
 		ascWriteReg(0xF29, 1);
-		__asm__ volatile ( "nop;" );
+		nop();
 		ascWriteReg(0xF29, 0);
 	}
 	else
 	{
 		via2WriteReg(0x1C13, 0x10);
-		__asm__ volatile ( "nop;" );
+		nop();
 		via2WriteReg(0x1C13, 0x90);
 	}
 
 	// Wait a very brief moment to see if anything happens
-	__asm__ volatile ( "nop; nop; nop; nop; nop; nop;" );
+	for (int i = 0; i < 6; i++)
+	{
+		nop();
+	}
 
 	// The IRQ handler will set fifoIRQFiredAfterToggleWhenFull if an IRQ occurs
 
 	irqState = DisableIRQ();
 	via2Handlers()[4] = originalASCIRQHandler;
-	if (results.regF09Exists)
+	if (r->regF09Exists)
 	{
 		ascWriteReg(0xF09, originalF09Value);
 	}
-	if (results.regF29Exists)
+	if (r->regF29Exists)
 	{
 		ascWriteReg(0xF29, originalF29Value);
 	}
@@ -1174,104 +1408,1954 @@ static void Test_FIFOIRQ_WhileFull(void)
 	RestoreIRQ(irqState);
 
 	// Wait a second for the FIFO to drain
+	waitTicks(60*1);
+}
+
+// Polls $804 for up to a second until each FIFO being watched shows the given state
+// in its two status bits (1 = half empty, 2 = full, 3 = empty), and timestamps when
+// it does. Returns false if one of them never got there.
+static bool WaitForFIFOState(bool watchA, bool watchB, uint8_t state, uint32_t *aUs, uint32_t *bUs)
+{
+	bool aSeen = !watchA;
+	bool bSeen = !watchB;
 	const uint32_t startTicks = ticks();
-	while (ticks() - startTicks < 60*1)
+	while (!(aSeen && bSeen) && !ticksElapsed(startTicks, 60*1))
 	{
+		const uint8_t status = ascReadReg(0x804);
+		if (!aSeen && (status & 0x03) == state)
+		{
+			*aUs = TimingNow();
+			aSeen = true;
+		}
+		if (!bSeen && ((status >> 2) & 0x03) == state)
+		{
+			*bUs = TimingNow();
+			bSeen = true;
+		}
 	}
+	return aSeen && bSeen;
 }
 
-// Runs all the tests
-void DoTests(void)
+// Keeps track of how long each block of samples took to play from one FIFO
+static void AddDrainBlock(uint32_t us, uint32_t *minUs, uint32_t *maxUs, uint32_t *totalUs)
 {
-	for (size_t i = 0; i < sizeof(tests)/sizeof(tests[0]); i++)
+	if (us < *minUs)
+	{
+		*minUs = us;
+	}
+	if (us > *maxUs)
 	{
-		tests[i]();
+		*maxUs = us;
 	}
+	*totalUs += us;
 }
 
-// Prints info about a FIFO test (stereo or mono)
-void PrintFIFOTests(const char *title, struct FIFOTestResults const *f)
+// Times how fast the FIFOs play. Fills them up, waits for them to drop to half empty,
+// and then several times over, writes a block of samples and times how long it takes
+// until they're back at half empty. Exactly that many samples were played in between,
+// whatever level the half empty flag actually turns on at. Finally lets them run dry
+// to time the second half. Only FIFOs whose status bits worked in the polling test
+// are timed.
+static void Test_DrainRate(TestResults *r)
 {
-	printf("%s:\n", title);
-	printf("%d %d %d %d %d %d %d %d %d %d %d %d (%u %u)\n",
-			f->aFullTooSoon, f->bFullTooSoon,
-			f->aReachesFull, f->bReachesFull,
-			f->aHalfEmptyIsOffWhenFull, f->bHalfEmptyIsOffWhenFull,
-			f->aHalfEmptyTurnsOn, f->bHalfEmptyTurnsOn,
-			f->aEmptyIsOffWhenHalfEmpty, f->bEmptyIsOffWhenHalfEmpty,
-			f->aReachesEmpty, f->bReachesEmpty,
-			f->aFullCount, f->bFullCount);
+	if (r->timerSource == TimingSourceTicks)
+	{
+		return;
+	}
+
+	// Only use mono if stereo isn't supported by this variant
+	const bool mono = !r->shouldTestStereo;
+	const bool enableF29 = r->regF29Exists;
+	const FIFOTestResults *f = mono ? &r->monoFIFO : &r->stereoFIFO;
+	DrainRateResults *d = &r->drainRate;
+	const bool timeA = !f->aFullTooSoon && f->aReachesFull && f->aHalfEmptyIsOffWhenFull &&
+		f->aHalfEmptyTurnsOn && f->aEmptyIsOffWhenHalfEmpty;
+	const bool timeB = !mono && !f->bFullTooSoon && f->bReachesFull && f->bHalfEmptyIsOffWhenFull &&
+		f->bHalfEmptyTurnsOn && f->bEmptyIsOffWhenHalfEmpty;
+	if (!timeA && !timeB)
+	{
+		return;
+	}
+	r->drainRateStereo = !mono;
+
+	uint16_t irqState = DisableIRQ();
+	const uint8_t originalMode = ascReadReg(0x801);
+	const uint8_t originalControl = ascReadReg(0x802);
+	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
+	const uint8_t originalF09Value = r->regF09Exists ? ascReadReg(0xF09) : 0;
+	const uint8_t originalF29Value = enableF29 ? ascReadReg(0xF29) : 0;
+
+	// Put in FIFO mode, mono or stereo
+	ascWriteReg(0x801, 1);
+	if (mono)
+	{
+		ascWriteReg(0x802, ascReadReg(0x802) & ~0x02);
+	}
+	else
+	{
+		ascWriteReg(0x802, ascReadReg(0x802) | 0x02);
+	}
+	// Clear the FIFO if needed
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+	// Make sure the ASC IRQ is disabled in VIA2 and F09/F29
+	via2WriteReg(0x1C13, 0x10);
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, 1);
+	}
+	if (enableF29)
+	{
+		ascWriteReg(0xF29, 1);
+	}
+
+	// Interrupts stay on, so Ticks keeps running for the timestamps
+	RestoreIRQ(irqState);
+
+	// Clear any old status bits just in case
+	(void)ascReadReg(0x804);
+
+	// Prime it with 0x100 samples so an empty FIFO isn't mistaken for a full one
+	for (int i = 0; i < 0x100; i++)
+	{
+		const uint8_t nextSample = (i & 0xFF);
+		ascWriteReg(0x0, nextSample);
+		if (!mono)
+		{
+			ascWriteReg(0x400, nextSample);
+		}
+	}
+
+	// Fill it up, noting when each FIFO is first seen to be full
+	uint32_t aFullUs = 0;
+	uint32_t bFullUs = 0;
+	bool aFull = !timeA;
+	bool bFull = !timeB;
+	for (int i = 0; i < 0x1000 && !(aFull && bFull); i++)
+	{
+		const uint8_t nextSample = (i & 0xFF);
+		ascWriteReg(0x0, nextSample);
+		if (!mono)
+		{
+			ascWriteReg(0x400, nextSample);
+		}
+		const uint8_t status = ascReadReg(0x804);
+		if (!aFull && (status & 0x03) == 0x02)
+		{
+			aFullUs = TimingNow();
+			aFull = true;
+		}
+		if (!bFull && (status & 0x0C) == 0x08)
+		{
+			bFullUs = TimingNow();
+			bFull = true;
+		}
+	}
+
+	uint32_t aHalfUs = 0;
+	uint32_t bHalfUs = 0;
+	bool ok = aFull && bFull && WaitForFIFOState(timeA, timeB, 0x01, &aHalfUs, &bHalfUs);
+	const uint32_t aFullToHalfUs = aHalfUs - aFullUs;
+	const uint32_t bFullToHalfUs = bHalfUs - bFullUs;
+
+	// Time the blocks
+	uint32_t aMinUs = UINT32_MAX;
+	uint32_t bMinUs = UINT32_MAX;
+	uint32_t aMaxUs = 0;
+	uint32_t bMaxUs = 0;
+	uint32_t aTotalUs = 0;
+	uint32_t bTotalUs = 0;
+	for (int block = 0; ok && block < DRAIN_BLOCKS; block++)
+	{
+		for (int i = 0; i < DRAIN_BLOCK_SAMPLES; i++)
+		{
+			const uint8_t nextSample = (i & 0xFF);
+			ascWriteReg(0x0, nextSample);
+			if (!mono)
+			{
+				ascWriteReg(0x400, nextSample);
+			}
+		}
+
+		// While the first few samples went in, the level may have dipped back down to
+		// half empty, which some variants latch. Clear that before waiting.
+		(void)ascReadReg(0x804);
+
+		const uint32_t aLastUs = aHalfUs;
+		const uint32_t bLastUs = bHalfUs;
+		ok = WaitForFIFOState(timeA, timeB, 0x01, &aHalfUs, &bHalfUs);
+		AddDrainBlock(aHalfUs - aLastUs, &aMinUs, &aMaxUs, &aTotalUs);
+		AddDrainBlock(bHalfUs - bLastUs, &bMinUs, &bMaxUs, &bTotalUs);
+	}
+
+	// Let it run dry, if the status shows when it's empty. If it never shows up, the
+	// time is left at 0.
+	const bool emptyA = timeA && f->aReachesEmpty;
+	const bool emptyB = timeB && f->bReachesEmpty;
+	uint32_t aEmptyUs = aHalfUs;
+	uint32_t bEmptyUs = bHalfUs;
+	if (ok && (emptyA || emptyB))
+	{
+		(void)WaitForFIFOState(emptyA, emptyB, 0x03, &aEmptyUs, &bEmptyUs);
+	}
+
+	irqState = DisableIRQ();
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+	(void)ascReadReg(0x804);
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, originalF09Value);
+	}
+	if (enableF29)
+	{
+		ascWriteReg(0xF29, originalF29Value);
+	}
+	via2WriteReg(0x1C13, irqOriginallyEnabledInVIA2 ? 0x90 : 0x10);
+	ascWriteReg(0x802, originalControl);
+	ascWriteReg(0x801, originalMode);
+	RestoreIRQ(irqState);
+
+	if (!ok)
+	{
+		return;
+	}
+
+	// Samples per microsecond, scaled up to thousandths of a Hz
+	const uint64_t scaledSamples = (uint64_t)DRAIN_BLOCK_SAMPLES * DRAIN_BLOCKS * 1000000000ULL;
+	if (timeA && aTotalUs)
+	{
+		d->aMeasured = true;
+		d->aFullToHalfUs = aFullToHalfUs;
+		d->aHalfToEmptyUs = aEmptyUs - aHalfUs;
+		d->aSampleRateMilliHz = (uint32_t)((scaledSamples + aTotalUs / 2) / aTotalUs);
+		d->aPeriodJitterUs = aMaxUs - aMinUs;
+	}
+	if (timeB && bTotalUs)
+	{
+		d->bMeasured = true;
+		d->bFullToHalfUs = bFullToHalfUs;
+		d->bHalfToEmptyUs = bEmptyUs - bHalfUs;
+		d->bSampleRateMilliHz = (uint32_t)((scaledSamples + bTotalUs / 2) / bTotalUs);
+		d->bPeriodJitterUs = bMaxUs - bMinUs;
+	}
 }
 
-int main(void)
+// Number of samples a FIFO playing at the given rate plays in the given time
+static int32_t SamplesPlayed(uint32_t rateMilliHz, uint32_t us)
+{
+	return (int32_t)(((uint64_t)rateMilliHz * us + 500000000ULL) / 1000000000ULL);
+}
+
+// Divides a total by the number of runs it was added up over, rounding to nearest
+static uint32_t AverageOfRuns(int32_t total)
 {
-	// Only do tests if we can
-	const uint32_t flags = addrMapFlags();
-	const bool via2Exists = flags & (1U << 11);
-	const bool ascExists = flags & (1U << 12);
-	const bool rbvExists = flags & (1U << 13);
+	return (total > 0) ? (uint32_t)((total + FIFO_DEPTH_RUNS / 2) / FIFO_DEPTH_RUNS) : 0;
+}
 
-	if (ascExists && (via2Exists || rbvExists))
+// Measures how many samples the FIFOs really hold when they're marked as full, and how
+// many are left when they're marked as half empty. The fill count from the FIFO tests
+// is too big, because samples play while the FIFO is being filled. Here the FIFO is
+// filled from empty as fast as possible with IRQs disabled and timed, and the samples
+// that played meanwhile (at the rate Test_DrainRate measured) are taken off. The half
+// empty level is then what's left after playing from full until the flag turns on.
+static void Test_FIFODepth(TestResults *r)
+{
+	const DrainRateResults *d = &r->drainRate;
+	const bool timeA = d->aMeasured;
+	const bool timeB = d->bMeasured;
+	if (!timeA && !timeB)
 	{
-		DoTests();
+		return;
 	}
 
-	printf("ASCTester test version 3\n");
+	const bool mono = !r->drainRateStereo;
+	const bool enableF29 = r->regF29Exists;
+	int32_t aDepthTotal = 0;
+	int32_t bDepthTotal = 0;
+	int32_t aHalfTotal = 0;
+	int32_t bHalfTotal = 0;
+	bool ok = true;
+
+	uint16_t irqState = DisableIRQ();
+	const uint8_t originalMode = ascReadReg(0x801);
+	const uint8_t originalControl = ascReadReg(0x802);
+	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
+	const uint8_t originalF09Value = r->regF09Exists ? ascReadReg(0xF09) : 0;
+	const uint8_t originalF29Value = enableF29 ? ascReadReg(0xF29) : 0;
+
+	// Put in FIFO mode, mono or stereo
+	ascWriteReg(0x801, 1);
+	if (mono)
+	{
+		ascWriteReg(0x802, ascReadReg(0x802) & ~0x02);
+	}
+	else
+	{
+		ascWriteReg(0x802, ascReadReg(0x802) | 0x02);
+	}
+	// Make sure the ASC IRQ is disabled in VIA2 and F09/F29
+	via2WriteReg(0x1C13, 0x10);
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, 1);
+	}
+	if (enableF29)
+	{
+		ascWriteReg(0xF29, 1);
+	}
+	RestoreIRQ(irqState);
 
-	if (ascExists && (via2Exists || rbvExists))
+	for (int run = 0; ok && run < FIFO_DEPTH_RUNS; run++)
 	{
-		printf("BoxFlag: %d   ASC Version: $%02X   System %d.%d.%d\n", results.boxFlag, results.ascVersion,
-				(results.sysVersion >> 8) & 0xFF, (results.sysVersion >> 4) & 0x0F,
-				results.sysVersion & 0x0F);
-		printf("AddrMapFlags: $%08X\n", flags);
-		printf("F09: %d ($%02X)  F29: %d ($%02X)\n",
-				results.regF09Exists, results.regF09InitialValue,
-				results.regF29Exists, results.regF29InitialValue);
-		printf("804Idle: $%02X  M0: %d M1: %d M2: %d ($%02X)\n",
-				results.reg804IdleValue, results.acceptsMode0, results.acceptsMode1, results.acceptsMode2, results.reg801InitialValue);
-		printf("Mono: %d %d Stereo: %d %d\n", results.acceptsConfigMono, results.shouldTestMono,
-				results.acceptsConfigStereo, results.shouldTestStereo);
+		irqState = DisableIRQ();
 
-		if (results.shouldTestMono)
+		// Start from empty
+		ascWriteReg(0x803, 0x80);
+		ascWriteReg(0x803, 0);
+		(void)ascReadReg(0x804);
+
+		// Fill it up. A FIFO counts as full when the full bit is on and the half empty
+		// bit is off, so an empty FIFO isn't mistaken for a full one.
+		uint32_t aWrites = 0;
+		uint32_t bWrites = 0;
+		uint32_t aFullUs = 0;
+		uint32_t bFullUs = 0;
+		const uint32_t startUs = TimingNow();
+		for (int i = 0; i < 0x1000 && ((timeA && !aWrites) || (timeB && !bWrites)); i++)
 		{
-			PrintFIFOTests("Mono FIFO Tests", &results.monoFIFO);
+			const uint8_t nextSample = (i & 0xFF);
+			ascWriteReg(0x0, nextSample);
+			if (!mono)
+			{
+				ascWriteReg(0x400, nextSample);
+			}
+			const uint8_t status = ascReadReg(0x804);
+			if (timeA && !aWrites && (status & 0x03) == 0x02)
+			{
+				aFullUs = TimingNow();
+				aWrites = i + 1;
+			}
+			if (timeB && !bWrites && (status & 0x0C) == 0x08)
+			{
+				bFullUs = TimingNow();
+				bWrites = i + 1;
+			}
 		}
-		if (results.shouldTestStereo)
+
+		// Waiting for half empty takes longer than Ticks can be held up for
+		RestoreIRQ(irqState);
+
+		uint32_t aHalfUs = 0;
+		uint32_t bHalfUs = 0;
+		ok = (!timeA || aWrites) && (!timeB || bWrites) &&
+			WaitForFIFOState(timeA, timeB, 0x01, &aHalfUs, &bHalfUs);
+		if (ok && timeA)
 		{
-			PrintFIFOTests("Stereo FIFO Tests", &results.stereoFIFO);
+			const int32_t depth = (int32_t)aWrites - SamplesPlayed(d->aSampleRateMilliHz, aFullUs - startUs);
+			aDepthTotal += depth;
+			aHalfTotal += depth - SamplesPlayed(d->aSampleRateMilliHz, aHalfUs - aFullUs);
 		}
-		printf("VIA2 (%d $%04X) %d\n", results.via2ReadbackConsistent, results.via2AddressDecodeMask, results.via2MirroringOK);
-		printf("Idle IRQ %d %d %d (%u), %d %d %d (%u), %d %d %d\n",
-				results.idleIRQWithoutF29, results.floodsIRQWithoutF29, results.irqFloodWithoutF29TakesOverCPU,
-				results.idleIRQWithoutF29Count,
-				results.idleIRQWithF29, results.floodsIRQWithF29, results.irqFloodWithF29TakesOverCPU,
-				results.idleIRQWithF29Count,
-				results.refiresIdleIRQWithF29, results.refiresIdleIRQFloodWithF29, results.irqFloodRefireWithF29TakesOverCPU);
-		printf("FIFO IRQ %d %d %d %d\n", results.testedFIFOIRQs, results.fifoIRQTestedWasA,
-				results.gotIRQOnFIFOHalfEmptyTooSoon, results.gotIRQOnFIFOEmptyTooSoon);
-		printf("(%u %u), (%u %u), (%u %u), (%u %u), %d\n",
-				results.fullIRQCount, results.fullIRQMaxDiff,
-				results.halfEmptyIRQCount, results.halfEmptyIRQMaxDiff,
-				results.emptyIRQCount, results.emptyIRQMaxDiff,
-				results.otherIRQCount, results.otherIRQMaxDiff,
-				results.fifoIRQFiredAfterToggleWhenFull);
-		if (ascVBLTask)
+		if (ok && timeB)
 		{
-			printf("ASC VBL Task was located and temporarily disabled during this test.\n");
+			const int32_t depth = (int32_t)bWrites - SamplesPlayed(d->bSampleRateMilliHz, bFullUs - startUs);
+			bDepthTotal += depth;
+			bHalfTotal += depth - SamplesPlayed(d->bSampleRateMilliHz, bHalfUs - bFullUs);
 		}
 	}
+
+	irqState = DisableIRQ();
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+	(void)ascReadReg(0x804);
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, originalF09Value);
+	}
+	if (enableF29)
+	{
+		ascWriteReg(0xF29, originalF29Value);
+	}
+	via2WriteReg(0x1C13, irqOriginallyEnabledInVIA2 ? 0x90 : 0x10);
+	ascWriteReg(0x802, originalControl);
+	ascWriteReg(0x801, originalMode);
+	RestoreIRQ(irqState);
+
+	if (!ok)
+	{
+		return;
+	}
+	r->aDepthMeasured = timeA;
+	r->bDepthMeasured = timeB;
+	r->aDepth = AverageOfRuns(aDepthTotal);
+	r->bDepth = AverageOfRuns(bDepthTotal);
+	r->aHalfEmptyLevel = AverageOfRuns(aHalfTotal);
+	r->bHalfEmptyLevel = AverageOfRuns(bHalfTotal);
+}
+
+// Times a loop that writes samples into the FIFOs, starting from empty each time, and
+// keeps the fastest of several runs. IRQs are disabled during each run.
+#define TIME_FIFO_WRITES(fastestUs, overheadUs, iterations, writes) \
+	for (int run = 0; run < CALIBRATION_RUNS; run++) \
+	{ \
+		const uint16_t irqState = DisableIRQ(); \
+		ascWriteReg(0x803, 0x80); \
+		ascWriteReg(0x803, 0); \
+		const uint32_t start = TimingNow(); \
+		for (int i = 0; i < (iterations); i++) \
+		{ \
+			writes \
+		} \
+		KeepFastest(&(fastestUs), TimingNow() - start, overheadUs); \
+		RestoreIRQ(irqState); \
+	}
+
+// Converts the time it took to write WRITE_RATE_SAMPLES to each FIFO to samples per second
+static uint32_t WriteRate(uint32_t us, int fifos)
+{
+	return us ? (uint32_t)((uint64_t)WRITE_RATE_SAMPLES * fifos * 1000000 / us) : 0;
+}
+
+// Times writing samples in the current mode with each kind of loop. In stereo, the
+// writes alternate between FIFO A and B, as a driver playing stereo would.
+static void TimeFIFOWrites(TestResults *r, bool stereo, FIFOWriteRateResults *w)
+{
+	const uint32_t overheadUs = (r->timerOverheadNs + 500) / 1000;
+	uint32_t byteUs = UINT32_MAX;
+	uint32_t unrolledUs = UINT32_MAX;
+	uint32_t wordUs = UINT32_MAX;
+	uint32_t longUs = UINT32_MAX;
+
+	if (stereo)
+	{
+		TIME_FIFO_WRITES(byteUs, overheadUs, WRITE_RATE_SAMPLES,
+			ascWriteReg(0x0, i); ascWriteReg(0x400, i);)
+		TIME_FIFO_WRITES(unrolledUs, overheadUs, WRITE_RATE_SAMPLES / 4,
+			ascWriteReg(0x0, i); ascWriteReg(0x400, i);
+			ascWriteReg(0x0, i); ascWriteReg(0x400, i);
+			ascWriteReg(0x0, i); ascWriteReg(0x400, i);
+			ascWriteReg(0x0, i); ascWriteReg(0x400, i);)
+		TIME_FIFO_WRITES(wordUs, overheadUs, WRITE_RATE_SAMPLES / 2,
+			ascWriteWord(0x0, i); ascWriteWord(0x400, i);)
+		TIME_FIFO_WRITES(longUs, overheadUs, WRITE_RATE_SAMPLES / 4,
+			ascWriteLong(0x0, i); ascWriteLong(0x400, i);)
+	}
 	else
 	{
-		printf("BoxFlag: %d cannot be tested. AddrMapFlags: $%08X\n", *(uint8_t *)BoxFlag, flags);
-		if (!ascExists)
+		TIME_FIFO_WRITES(byteUs, overheadUs, WRITE_RATE_SAMPLES,
+			ascWriteReg(0x0, i);)
+		TIME_FIFO_WRITES(unrolledUs, overheadUs, WRITE_RATE_SAMPLES / 4,
+			ascWriteReg(0x0, i); ascWriteReg(0x0, i);
+			ascWriteReg(0x0, i); ascWriteReg(0x0, i);)
+		TIME_FIFO_WRITES(wordUs, overheadUs, WRITE_RATE_SAMPLES / 2,
+			ascWriteWord(0x0, i);)
+		TIME_FIFO_WRITES(longUs, overheadUs, WRITE_RATE_SAMPLES / 4,
+			ascWriteLong(0x0, i);)
+	}
+
+	const int fifos = stereo ? 2 : 1;
+	w->measured = true;
+	w->byteRate = WriteRate(byteUs, fifos);
+	w->unrolledRate = WriteRate(unrolledUs, fifos);
+	w->wordRate = WriteRate(wordUs, fifos);
+	w->longRate = WriteRate(longUs, fifos);
+}
+
+// Fills a FIFO from empty with writes of the given size (2 or 4 bytes) until it's
+// marked as full, and works out how many samples each write put in it from the
+// FIFO's depth and the samples that played meanwhile. Returns 0 if it never filled,
+// meaning the writes were dropped.
+static uint8_t SamplesPerWideWrite(TestResults *r, int bytes)
+{
+	const bool fifoA = r->aDepthMeasured;
+	const uint16_t fifoOffset = fifoA ? 0x0 : 0x400;
+	const int shift = fifoA ? 0 : 2;
+	const uint32_t depth = fifoA ? r->aDepth : r->bDepth;
+	const uint32_t rateMilliHz = fifoA ? r->drainRate.aSampleRateMilliHz : r->drainRate.bSampleRateMilliHz;
+	uint32_t writes = 0;
+	uint32_t fullUs = 0;
+
+	const uint16_t irqState = DisableIRQ();
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+	(void)ascReadReg(0x804);
+	const uint32_t startUs = TimingNow();
+	for (int i = 0; i < 0x1000; i++)
+	{
+		if (bytes == 2)
+		{
+			ascWriteWord(fifoOffset, 0x8080);
+		}
+		else
+		{
+			ascWriteLong(fifoOffset, 0x80808080UL);
+		}
+		if (((ascReadReg(0x804) >> shift) & 0x03) == 0x02)
+		{
+			fullUs = TimingNow();
+			writes = i + 1;
+			break;
+		}
+	}
+	RestoreIRQ(irqState);
+
+	if (!writes)
+	{
+		return 0;
+	}
+	const uint32_t samples = depth + SamplesPlayed(rateMilliHz, fullUs - startUs);
+	return (uint8_t)((samples + writes / 2) / writes);
+}
+
+// Measures how fast samples can be written into the FIFOs, which is as fast as a sound
+// driver could possibly fill them, and whether the FIFOs take word and long word
+// writes as several samples.
+static void Test_FIFOWriteRate(TestResults *r)
+{
+	if (r->timerSource == TimingSourceTicks)
+	{
+		return;
+	}
+
+	const bool enableF29 = r->regF29Exists;
+	uint16_t irqState = DisableIRQ();
+	const uint8_t originalMode = ascReadReg(0x801);
+	const uint8_t originalControl = ascReadReg(0x802);
+	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
+	const uint8_t originalF09Value = r->regF09Exists ? ascReadReg(0xF09) : 0;
+	const uint8_t originalF29Value = enableF29 ? ascReadReg(0xF29) : 0;
+
+	// Put in FIFO mode, and make sure the ASC IRQ is disabled in VIA2 and F09/F29
+	ascWriteReg(0x801, 1);
+	via2WriteReg(0x1C13, 0x10);
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, 1);
+	}
+	if (enableF29)
+	{
+		ascWriteReg(0xF29, 1);
+	}
+	RestoreIRQ(irqState);
+
+	if (r->shouldTestMono)
+	{
+		ascWriteReg(0x802, originalControl & ~0x02);
+		TimeFIFOWrites(r, false, &r->monoWriteRate);
+	}
+	if (r->shouldTestStereo)
+	{
+		ascWriteReg(0x802, originalControl | 0x02);
+		TimeFIFOWrites(r, true, &r->stereoWriteRate);
+	}
+
+	// Check wide writes in the mode the FIFO depth was measured in, since we need
+	// to know how many samples fill it
+	if (r->aDepthMeasured || r->bDepthMeasured)
+	{
+		if (r->drainRateStereo)
 		{
-			printf("- ASC address map flag isn't valid\n");
+			ascWriteReg(0x802, originalControl | 0x02);
 		}
-		if (!via2Exists && !rbvExists)
+		else
 		{
-			printf("- VIA2 and RBV address map flags aren't valid\n");
+			ascWriteReg(0x802, originalControl & ~0x02);
 		}
+		r->checkedWideWrites = true;
+		r->samplesPerWordWrite = SamplesPerWideWrite(r, 2);
+		r->samplesPerLongWrite = SamplesPerWideWrite(r, 4);
 	}
 
+	irqState = DisableIRQ();
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+	(void)ascReadReg(0x804);
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, originalF09Value);
+	}
+	if (enableF29)
+	{
+		ascWriteReg(0xF29, originalF29Value);
+	}
+	via2WriteReg(0x1C13, irqOriginallyEnabledInVIA2 ? 0x90 : 0x10);
+	ascWriteReg(0x802, originalControl);
+	ascWriteReg(0x801, originalMode);
+	RestoreIRQ(irqState);
+}
+
+// IRQ handler used for timing IRQ latency. Timestamps the IRQ first thing, and then
+// keeps it from firing again until the main program has refilled the FIFO.
+static void Test_IRQLatencyHandler(void)
+{
+	const uint32_t now = TimingNow();
+
+	via2WriteReg(0x1C13, 0x10);
+	via2WriteReg(0x1A03, 0x90);
+	(void)ascReadReg(0x804);
+
+	TestResults *r = resultsFromIRQ();
+	r->tmpIRQTimeUs = now;
+	r->tmpIRQCount++;
+}
+
+// Sorts latencies, smallest first. There are few enough for an insertion sort.
+static void SortLatencies(uint32_t *us, int count)
+{
+	for (int i = 1; i < count; i++)
+	{
+		const uint32_t value = us[i];
+		int j = i;
+		while (j > 0 && us[j - 1] > value)
+		{
+			us[j] = us[j - 1];
+			j--;
+		}
+		us[j] = value;
+	}
+}
+
+// Measures how long it takes from the FIFO reaching half empty until the half empty
+// IRQ handler runs. The moment it reaches half empty is worked out rather than
+// observed: once it's seen to be half empty by polling, the main program writes
+// another DRAIN_BLOCK_SAMPLES samples, which at the rate Test_DrainRate measured will
+// take a known time to play, and lets the IRQ through. The IRQ is held off while it
+// writes them, so nothing fires until they've played. Blocks timed by polling and by
+// the IRQ take turns, so small errors in the rate don't add up.
+static void Test_IRQLatency(TestResults *r)
+{
+	uint32_t *latencies = r->tmpIRQLatencies;
+
+	if (!r->testedFIFOIRQs)
+	{
+		return;
+	}
+
+	const bool fifoA = r->fifoIRQTestedWasA;
+	const uint32_t rateMilliHz = fifoA ? r->drainRate.aSampleRateMilliHz : r->drainRate.bSampleRateMilliHz;
+	if (!(fifoA ? r->drainRate.aMeasured : r->drainRate.bMeasured))
+	{
+		return;
+	}
+
+	const bool mono = !r->drainRateStereo;
+	const bool enableF29 = r->regF29Exists;
+	int samples = 0;
+
+	uint16_t irqState = DisableIRQ();
+	const uint8_t originalMode = ascReadReg(0x801);
+	const uint8_t originalControl = ascReadReg(0x802);
+	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
+	const uint8_t originalF09Value = r->regF09Exists ? ascReadReg(0xF09) : 0;
+	const uint8_t originalF29Value = enableF29 ? ascReadReg(0xF29) : 0;
+	VIA2Handler originalASCIRQHandler = via2Handlers()[4];
+	*(TestResults **)applScratch() = r;
+	via2Handlers()[4] = Test_IRQLatencyHandler;
+
+	// Put in FIFO mode, mono or stereo, starting from empty
+	ascWriteReg(0x801, 1);
+	if (mono)
+	{
+		ascWriteReg(0x802, ascReadReg(0x802) & ~0x02);
+	}
+	else
+	{
+		ascWriteReg(0x802, ascReadReg(0x802) | 0x02);
+	}
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+
+	// The ASC IRQ is only let through VIA2 while we wait for it; F09/F29 are set up
+	// the same way Test_FIFOIRQ does
+	via2WriteReg(0x1C13, 0x10);
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, 1);
+	}
+	if (enableF29)
+	{
+		ascWriteReg(0xF29, 0);
+	}
+	RestoreIRQ(irqState);
+
+	// How long a block takes to play
+	const uint32_t blockUs = (uint32_t)(((uint64_t)DRAIN_BLOCK_SAMPLES * 1000000000ULL + rateMilliHz / 2) /
+		rateMilliHz);
+
+	// Start out past half full
+	if (mono)
+	{
+		WriteSamples<false>(0x300);
+	}
+	else
+	{
+		WriteSamples<true>(0x300);
+	}
+
+	bool ok = true;
+	for (int i = 0; ok && i < IRQ_LATENCY_SAMPLES; i++)
+	{
+		// Find out when it gets down to half empty by polling
+		(void)ascReadReg(0x804);
+		uint32_t halfEmptyUs = 0;
+		if (!WaitForFIFOState(fifoA, !fifoA, 0x01, &halfEmptyUs, &halfEmptyUs))
+		{
+			break;
+		}
+
+		// Then give it another block and wait for the IRQ
+		if (mono)
+		{
+			WriteSamples<false>(DRAIN_BLOCK_SAMPLES);
+		}
+		else
+		{
+			WriteSamples<true>(DRAIN_BLOCK_SAMPLES);
+		}
+
+		// Clear anything that was flagged while writing, then let the IRQ through
+		irqState = DisableIRQ();
+		(void)ascReadReg(0x804);
+		via2WriteReg(0x1A03, 0x90);
+		r->tmpIRQCount = 0;
+		via2WriteReg(0x1C13, 0x90);
+		RestoreIRQ(irqState);
+
+		const uint32_t startTicks = ticks();
+		while (!r->tmpIRQCount && !ticksElapsed(startTicks, 60*1))
+		{
+		}
+		ok = r->tmpIRQCount > 0;
+		if (!ok)
+		{
+			break;
+		}
+
+		const int32_t latency = (int32_t)(r->tmpIRQTimeUs - (halfEmptyUs + blockUs));
+		latencies[samples++] = (latency > 0) ? (uint32_t)latency : 0;
+
+		// Set up the next block to be timed by polling
+		if (mono)
+		{
+			WriteSamples<false>(DRAIN_BLOCK_SAMPLES);
+		}
+		else
+		{
+			WriteSamples<true>(DRAIN_BLOCK_SAMPLES);
+		}
+	}
+
+	irqState = DisableIRQ();
+	via2Handlers()[4] = originalASCIRQHandler;
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+	(void)ascReadReg(0x804);
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, originalF09Value);
+	}
+	if (enableF29)
+	{
+		ascWriteReg(0xF29, originalF29Value);
+	}
+	via2WriteReg(0x1A03, 0x90);
+	via2WriteReg(0x1C13, irqOriginallyEnabledInVIA2 ? 0x90 : 0x10);
+	ascWriteReg(0x802, originalControl);
+	ascWriteReg(0x801, originalMode);
+	RestoreIRQ(irqState);
+
+	if (!samples)
+	{
+		return;
+	}
+	SortLatencies(latencies, samples);
+	r->irqLatencySamples = samples;
+	r->irqLatencyMinUs = latencies[0];
+	r->irqLatencyMedianUs = latencies[samples / 2];
+	r->irqLatencyP99Us = latencies[(samples * 99 + 99) / 100 - 1];
+	r->irqLatencyMaxUs = latencies[samples - 1];
+	for (int i = 0; i < samples; i++)
+	{
+		int bucket = 0;
+		while (bucket < IRQ_LATENCY_BUCKETS - 1 && latencies[i] >= (8UL << bucket))
+		{
+			bucket++;
+		}
+		r->irqLatencyHistogram[bucket]++;
+	}
+}
+
+// IRQ handler used for recording the FIFO IRQ timeline. It only records what it sees;
+// the main program works out what it means.
+template <bool fifoA>
+static void Test_FIFOIRQTimelineHandler(void)
+{
+	const uint32_t now = TimingNow();
+
+	// Acknowledge the IRQ
+	via2WriteReg(0x1A03, 0x90);
+
+	const uint8_t status = ascReadReg(0x804);
+
+	TestResults *r = resultsFromIRQ();
+	IRQEventPush(&r->tmpIRQEvents, now, status, fifoA ? IRQEventFIFOAHandler : IRQEventFIFOBHandler);
+
+	// Safety: if the IRQs flood, disable them
+	if (CountIRQ(r, &r->tmpIRQCount, 0))
+	{
+		via2WriteReg(0x1C13, 0x10);
+	}
+}
+
+// Writes up to 0x1000 samples, stopping at the first IRQ
+template <bool stereo>
+static void FillUntilIRQ(const TestResults *r)
+{
+	for (int i = 0; i < 0x1000; i++)
+	{
+		WriteSample<stereo>(i & 0xFF);
+		if (r->tmpIRQCount > 0)
+		{
+			break;
+		}
+	}
+}
+
+// Adds an IRQ to the timeline. IRQs in a row with the same status make up a run.
+// lastStatus is the status of the IRQ before (or -1 for the first one), which is
+// needed to tell where a run starts once the timeline is full.
+static void AddToTimeline(TestResults *r, const IRQEvent *e, uint32_t startUs, int *lastStatus)
+{
+	const uint8_t status = (e->handler == IRQEventFIFOAHandler) ?
+		FIFOStatusBits<true>(e->status) : FIFOStatusBits<false>(e->status);
+	const uint32_t us = e->timeUs - startUs;
+
+	r->irqTimelineIRQs++;
+	if (status == *lastStatus)
+	{
+		if (!r->irqTimelineMoreRuns)
+		{
+			IRQTimelineRun *run = &r->irqTimeline[r->irqTimelineRunCount - 1];
+			run->count++;
+			run->spanUs = us - run->startUs;
+		}
+		return;
+	}
+
+	*lastStatus = status;
+	if (r->irqTimelineRunCount < IRQ_TIMELINE_RUNS)
+	{
+		IRQTimelineRun *run = &r->irqTimeline[r->irqTimelineRunCount++];
+		run->status = status;
+		run->count = 1;
+		run->startUs = us;
+		run->spanUs = 0;
+	}
+	else
+	{
+		r->irqTimelineMoreRuns++;
+	}
+}
+
+// Runs the FIFO IRQ test again, this time recording when each IRQ came and what the
+// status was, so it can be seen how the IRQs develop as the FIFO drains (for example,
+// a burst of half empty IRQs turning into a flood of empty ones). The handler puts
+// each IRQ in a queue and the main program takes them out as it waits. Test_FIFOIRQ
+// itself sticks to counting, so its results stay comparable with older ones.
+static void Test_FIFOIRQTimeline(TestResults *r)
+{
+	if (!r->testedFIFOIRQs || r->timerSource == TimingSourceTicks)
+	{
+		return;
+	}
+
+	const bool mono = !r->shouldTestStereo;
+	const bool enableF29 = r->regF29Exists;
+	int lastStatus = -1;
+
+	uint16_t irqState = DisableIRQ();
+	const uint8_t originalMode = ascReadReg(0x801);
+	const uint8_t originalControl = ascReadReg(0x802);
+	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
+	const uint8_t originalF09Value = r->regF09Exists ? ascReadReg(0xF09) : 0;
+	const uint8_t originalF29Value = enableF29 ? ascReadReg(0xF29) : 0;
+	VIA2Handler originalASCIRQHandler = via2Handlers()[4];
+	*(TestResults **)applScratch() = r;
+	IRQEventQueueReset(&r->tmpIRQEvents);
+	r->tmpIRQCount = 0;
+	ResetIRQFloodDetection(r);
+	via2Handlers()[4] = r->fifoIRQTestedWasA ? Test_FIFOIRQTimelineHandler<true> : Test_FIFOIRQTimelineHandler<false>;
+
+	// Put in FIFO mode, mono or stereo, starting from empty
+	ascWriteReg(0x801, 1);
+	if (mono)
+	{
+		ascWriteReg(0x802, ascReadReg(0x802) & ~0x02);
+	}
+	else
+	{
+		ascWriteReg(0x802, ascReadReg(0x802) | 0x02);
+	}
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+	(void)ascReadReg(0x804);
+
+	// Fill it past half full, and then turn on IRQs the same way Test_FIFOIRQ does
+	if (mono)
+	{
+		WriteSamples<false>(0x300);
+	}
+	else
+	{
+		WriteSamples<true>(0x300);
+	}
+	via2WriteReg(0x1A03, 0x90);
+	via2WriteReg(0x1C13, 0x90);
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, 1);
+	}
+	if (enableF29)
+	{
+		ascWriteReg(0xF29, 0);
+	}
+	const uint32_t startUs = TimingNow();
+	RestoreIRQ(irqState);
+
+	// Keep filling until the first IRQ, which is the one for the FIFO being full on
+	// variants that have it
+	if (mono)
+	{
+		FillUntilIRQ<false>(r);
+	}
+	else
+	{
+		FillUntilIRQ<true>(r);
+	}
+
+	// Let it drain for 4 seconds, or until the IRQs flood, going through the IRQs as
+	// they come
+	IRQEvent e;
+	const uint32_t startTicks = ticks();
+	while (!ticksElapsed(startTicks, 60*4))
+	{
+		const bool flooded = r->tmpIRQFlooded;
+		while (IRQEventPop(&r->tmpIRQEvents, &e))
+		{
+			AddToTimeline(r, &e, startUs, &lastStatus);
+		}
+		if (flooded)
+		{
+			break;
+		}
+	}
+
+	irqState = DisableIRQ();
+	via2Handlers()[4] = originalASCIRQHandler;
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+	(void)ascReadReg(0x804);
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, originalF09Value);
+	}
+	if (enableF29)
+	{
+		ascWriteReg(0xF29, originalF29Value);
+	}
+	via2WriteReg(0x1A03, 0x90);
+	via2WriteReg(0x1C13, irqOriginallyEnabledInVIA2 ? 0x90 : 0x10);
+	ascWriteReg(0x802, originalControl);
+	ascWriteReg(0x801, originalMode);
+	RestoreIRQ(irqState);
+
+	// Take whatever came in after the last look
+	while (IRQEventPop(&r->tmpIRQEvents, &e))
+	{
+		AddToTimeline(r, &e, startUs, &lastStatus);
+	}
+	r->irqTimelineRecorded = true;
+	r->irqTimelineFlooded = r->tmpIRQFlooded;
+	r->irqTimelineDropped = r->tmpIRQEvents.dropped;
+}
+
+// Does units of work (a few nops each) from startUs until windowUs later, and returns
+// how many it did per second. Whatever IRQs are enabled take their time out of
+// that. startUs is taken by the caller before it enables them, so that an IRQ flood
+// that keeps this from running at all still counts.
+static uint32_t MainLoopRate(uint32_t startUs, uint32_t windowUs)
+{
+	uint32_t units = 0;
+	uint32_t elapsedUs;
+	do
+	{
+		for (int i = 0; i < IRQ_CPU_WORK_NOPS; i++)
+		{
+			nop();
+		}
+		units++;
+		elapsedUs = TimingNow() - startUs;
+	} while (elapsedUs < windowUs);
+
+	return (uint32_t)((uint64_t)units * 1000000 / elapsedUs);
+}
+
+// How much of the CPU the IRQs took, in tenths of a percent, going by how much less
+// work the main program got done than with no IRQs
+static uint32_t CPUUsePermille(uint32_t baselineRate, uint32_t rate)
+{
+	if (rate >= baselineRate)
+	{
+		return 0;
+	}
+	return (uint32_t)((uint64_t)(baselineRate - rate) * 1000 / baselineRate);
+}
+
+// IRQ handler that keeps a FIFO playing: each time it's half empty (or worse), it
+// writes another IRQ_CPU_REFILL_SAMPLES samples
+template <bool stereo, bool fifoA>
+static void Test_IRQCPUStreamHandler(void)
+{
+	// Acknowledge the IRQ
+	via2WriteReg(0x1A03, 0x90);
+
+	const uint8_t status = FIFOStatusBits<fifoA>(ascReadReg(0x804));
+	if (status == 0x01 || status == 0x03)
+	{
+		WriteSamples<stereo>(IRQ_CPU_REFILL_SAMPLES);
+	}
+
+	// Safety: if the IRQs flood, disable them
+	TestResults *r = resultsFromIRQ();
+	if (CountIRQ(r, &r->tmpIRQCount, 0))
+	{
+		via2WriteReg(0x1C13, 0x10);
+	}
+}
+
+// Indexed by [stereo][fifoA]
+static void (*const irqCPUStreamHandlers[2][2])(void) =
+{
+	{ Test_IRQCPUStreamHandler<false, false>, Test_IRQCPUStreamHandler<false, true> },
+	{ Test_IRQCPUStreamHandler<true, false>, Test_IRQCPUStreamHandler<true, true> },
+};
+
+// Times the main program's work with the idle IRQ set up the way Test_IdleIRQ does
+// when it floods, and returns how much of the CPU the flood took. With toggleF29,
+// $F29 is also set to 1 and back to 0, the way Test_IdleIRQ makes it refire.
+static uint32_t IdleFloodCPUUse(TestResults *r, bool enableF29, bool toggleF29)
+{
+	uint16_t irqState = DisableIRQ();
+	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
+	const uint8_t originalF09Value = r->regF09Exists ? ascReadReg(0xF09) : 0;
+	const uint8_t originalF29Value = r->regF29Exists ? ascReadReg(0xF29) : 0;
+	VIA2Handler originalASCIRQHandler = via2Handlers()[4];
+	*(TestResults **)applScratch() = r;
+	r->tmpIRQCount = 0;
+	ResetIRQFloodDetection(r);
+	via2Handlers()[4] = Test_IdleIRQHandler;
+	via2WriteReg(0x1C13, 0x90);
+	via2WriteReg(0x1A03, 0x90);
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, 1);
+	}
+	if (r->regF29Exists)
+	{
+		ascWriteReg(0xF29, enableF29 ? 0 : 1);
+		if (toggleF29)
+		{
+			ascWriteReg(0xF29, 1);
+			ascWriteReg(0xF29, 0);
+		}
+	}
+	const uint32_t startUs = TimingNow();
+	RestoreIRQ(irqState);
+
+	const uint32_t rate = MainLoopRate(startUs, IRQ_CPU_WINDOW_US);
+
+	irqState = DisableIRQ();
+	via2Handlers()[4] = originalASCIRQHandler;
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, originalF09Value);
+	}
+	if (r->regF29Exists)
+	{
+		ascWriteReg(0xF29, originalF29Value);
+	}
+	via2WriteReg(0x1A03, 0x90);
+	via2WriteReg(0x1C13, irqOriginallyEnabledInVIA2 ? 0x90 : 0x10);
+	RestoreIRQ(irqState);
+
+	return CPUUsePermille(r->irqCPUBaselineRate, rate);
+}
+
+// Measures how much of the CPU servicing the ASC IRQ takes, by timing how much work
+// the main program gets done with the ASC IRQ disabled, while the IRQ keeps a FIFO
+// playing, and in each idle IRQ flood that Test_IdleIRQ found
+static void Test_IRQCPUUse(TestResults *r)
+{
+	if (r->timerSource == TimingSourceTicks)
+	{
+		return;
+	}
+
+	// With the ASC IRQ disabled, nothing but the OS's own interrupts gets in the way
+	uint16_t irqState = DisableIRQ();
+	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
+	via2WriteReg(0x1C13, 0x10);
+	const uint32_t baselineStartUs = TimingNow();
+	RestoreIRQ(irqState);
+	r->irqCPUBaselineRate = MainLoopRate(baselineStartUs, IRQ_CPU_WINDOW_US);
+	irqState = DisableIRQ();
+	via2WriteReg(0x1C13, irqOriginallyEnabledInVIA2 ? 0x90 : 0x10);
+	RestoreIRQ(irqState);
+	r->irqCPUMeasured = true;
+
+	// Streaming, in the same mode and with the same FIFO's status bits as Test_FIFOIRQ
+	if (r->testedFIFOIRQs)
+	{
+		const bool mono = !r->shouldTestStereo;
+		const bool enableF29 = r->regF29Exists;
+
+		irqState = DisableIRQ();
+		const uint8_t originalMode = ascReadReg(0x801);
+		const uint8_t originalControl = ascReadReg(0x802);
+		const uint8_t originalF09Value = r->regF09Exists ? ascReadReg(0xF09) : 0;
+		const uint8_t originalF29Value = enableF29 ? ascReadReg(0xF29) : 0;
+		VIA2Handler originalASCIRQHandler = via2Handlers()[4];
+		*(TestResults **)applScratch() = r;
+		r->tmpIRQCount = 0;
+		ResetIRQFloodDetection(r);
+		via2Handlers()[4] = irqCPUStreamHandlers[!mono][r->fifoIRQTestedWasA];
+
+		ascWriteReg(0x801, 1);
+		if (mono)
+		{
+			ascWriteReg(0x802, ascReadReg(0x802) & ~0x02);
+		}
+		else
+		{
+			ascWriteReg(0x802, ascReadReg(0x802) | 0x02);
+		}
+		ascWriteReg(0x803, 0x80);
+		ascWriteReg(0x803, 0);
+		if (mono)
+		{
+			WriteSamples<false>(0x300);
+		}
+		else
+		{
+			WriteSamples<true>(0x300);
+		}
+		(void)ascReadReg(0x804);
+		via2WriteReg(0x1A03, 0x90);
+		via2WriteReg(0x1C13, 0x90);
+		if (r->regF09Exists)
+		{
+			ascWriteReg(0xF09, 1);
+		}
+		if (enableF29)
+		{
+			ascWriteReg(0xF29, 0);
+		}
+		const uint32_t startUs = TimingNow();
+		RestoreIRQ(irqState);
+
+		const uint32_t rate = MainLoopRate(startUs, IRQ_CPU_STREAM_WINDOW_US);
+		const uint32_t elapsedUs = TimingNow() - startUs;
+		const uint32_t irqs = r->tmpIRQCount;
+
+		irqState = DisableIRQ();
+		via2Handlers()[4] = originalASCIRQHandler;
+		ascWriteReg(0x803, 0x80);
+		ascWriteReg(0x803, 0);
+		(void)ascReadReg(0x804);
+		if (r->regF09Exists)
+		{
+			ascWriteReg(0xF09, originalF09Value);
+		}
+		if (enableF29)
+		{
+			ascWriteReg(0xF29, originalF29Value);
+		}
+		via2WriteReg(0x1A03, 0x90);
+		via2WriteReg(0x1C13, irqOriginallyEnabledInVIA2 ? 0x90 : 0x10);
+		ascWriteReg(0x802, originalControl);
+		ascWriteReg(0x801, originalMode);
+		RestoreIRQ(irqState);
+
+		r->irqCPUStreamMeasured = true;
+		r->irqCPUStreamPermille = CPUUsePermille(r->irqCPUBaselineRate, rate);
+		r->irqCPUStreamIRQRate = (uint32_t)((uint64_t)irqs * 1000000 / elapsedUs);
+	}
+
+	// The floods
+	if (r->floodsIRQWithoutF29)
+	{
+		r->irqCPUIdleFloodMeasured = true;
+		r->irqCPUIdleFloodPermille = IdleFloodCPUUse(r, false, false);
+	}
+	if (r->floodsIRQWithF29)
+	{
+		r->irqCPUIdleF29FloodMeasured = true;
+		r->irqCPUIdleF29FloodPermille = IdleFloodCPUUse(r, true, false);
+	}
+	if (r->refiresIdleIRQFloodWithF29)
+	{
+		r->irqCPURefireFloodMeasured = true;
+		r->irqCPURefireFloodPermille = IdleFloodCPUUse(r, true, true);
+	}
+}
+
+// IRQ handler that streams samples from the buffer into the FIFO, a chunk each time it's
+// half empty
+template <bool stereo, bool fifoA>
+static void Test_StreamingHandler(void)
+{
+	const uint32_t startUs = TimingNow();
+
+	// Acknowledge the IRQ
+	via2WriteReg(0x1A03, 0x90);
+
+	const uint8_t status = FIFOStatusBits<fifoA>(ascReadReg(0x804));
+
+	TestResults *r = resultsFromIRQ();
+	StreamState *s = &r->tmpStream;
+	s->lastIRQUs = startUs;
+	s->irqs++;
+
+	if (status == 0x01 || status == 0x03)
+	{
+		// Once the FIFO has run dry, there's no telling when it'll next be half empty
+		if (status == 0x03 && s->emptyMeansUnderrun)
+		{
+			s->underruns++;
+			s->halfEmptyKnown = false;
+		}
+
+		for (int i = 0; i < s->chunk; i++)
+		{
+			WriteSample<stereo>(s->buffer[s->half][s->pos]);
+			if (++s->pos == STREAM_BUFFER_HALF)
+			{
+				s->halfFree[s->half] = true;
+				s->half ^= 1;
+				s->pos = 0;
+
+				// If the main program hasn't refilled the next half yet, what's in it
+				// has already been played
+				if (s->halfFree[s->half])
+				{
+					s->underruns++;
+				}
+			}
+		}
+
+		// The refill is timed from when the FIFO reached half empty. It gets back
+		// there once the chunk it was just given has played.
+		if (s->halfEmptyKnown)
+		{
+			const int32_t refillUs = (int32_t)(TimingNow() - s->halfEmptyUs);
+			if (refillUs > 0)
+			{
+				s->refillTotalUs += refillUs;
+				if ((uint32_t)refillUs > s->refillMaxUs)
+				{
+					s->refillMaxUs = refillUs;
+				}
+			}
+			s->refills++;
+			s->halfEmptyFraction += s->chunkTime;
+			s->halfEmptyUs += s->halfEmptyFraction >> STREAM_TIME_FRACTION_BITS;
+			s->halfEmptyFraction &= (1UL << STREAM_TIME_FRACTION_BITS) - 1;
+		}
+	}
+
+	// Safety: if the IRQs flood, disable them
+	if (CountIRQ(r, &r->tmpIRQCount, 0))
+	{
+		via2WriteReg(0x1C13, 0x10);
+	}
+}
+
+// Indexed by [stereo][fifoA]
+static void (*const streamingHandlers[2][2])(void) =
+{
+	{ Test_StreamingHandler<false, false>, Test_StreamingHandler<false, true> },
+	{ Test_StreamingHandler<true, false>, Test_StreamingHandler<true, true> },
+};
+
+// Fills any half of the stream's buffer the handler is done with (a sawtooth wave)
+static void FillStreamBuffer(StreamState *s)
+{
+	for (int h = 0; h < 2; h++)
+	{
+		if (s->halfFree[h])
+		{
+			for (int i = 0; i < STREAM_BUFFER_HALF; i++)
+			{
+				s->buffer[h][i] = s->nextSample++;
+			}
+			s->halfFree[h] = false;
+		}
+	}
+}
+
+// Starts the stream (again) and lets the IRQ through. If the refills can be timed,
+// this finds out when the FIFO will next be half empty the way Test_IRQLatency does:
+// it fills the FIFO past half full, polls until it's half empty, and gives it one
+// chunk, which at the drain rate takes a known time to play. Otherwise the FIFO is
+// just filled past half full, so the first IRQ is for it getting down to half empty.
+static void StartStream(StreamState *s, bool stereo)
+{
+	uint16_t irqState = DisableIRQ();
+	via2WriteReg(0x1C13, 0x10);
+	s->halfEmptyKnown = false;
+	RestoreIRQ(irqState);
+
+	if (stereo)
+	{
+		WriteSamples<true>(0x300);
+	}
+	else
+	{
+		WriteSamples<false>(0x300);
+	}
+
+	if (s->rateMilliHz)
+	{
+		(void)ascReadReg(0x804);
+		uint32_t halfEmptyUs = 0;
+		if (WaitForFIFOState(s->fifoA, !s->fifoA, 0x01, &halfEmptyUs, &halfEmptyUs))
+		{
+			if (stereo)
+			{
+				WriteSamples<true>(s->chunk);
+			}
+			else
+			{
+				WriteSamples<false>(s->chunk);
+			}
+			s->halfEmptyKnown = true;
+			s->halfEmptyUs = halfEmptyUs + (s->chunkTime >> STREAM_TIME_FRACTION_BITS);
+			s->halfEmptyFraction = s->chunkTime & ((1UL << STREAM_TIME_FRACTION_BITS) - 1);
+		}
+	}
+
+	// Clear anything that was flagged while writing, then let the IRQ through
+	irqState = DisableIRQ();
+	(void)ascReadReg(0x804);
+	via2WriteReg(0x1A03, 0x90);
+	via2WriteReg(0x1C13, 0x90);
+	s->lastIRQUs = TimingNow();
+	RestoreIRQ(irqState);
+}
+
+// Streams with one chunk size for STREAM_RUN_US while the main program does units of
+// work, the way MainLoopRate does, and keeps the buffer filled
+static void StreamWithChunk(TestResults *r, StreamState *s, StreamingResults *sr, bool stereo, int n)
+{
+	uint16_t irqState = DisableIRQ();
+	s->chunk = 0x200 >> n;
+	s->chunkTime = s->rateMilliHz ?
+		(uint32_t)(((uint64_t)s->chunk * 1000000000ULL << STREAM_TIME_FRACTION_BITS) / s->rateMilliHz) : 0;
+	s->underruns = 0;
+	s->irqs = 0;
+	s->refills = 0;
+	s->refillTotalUs = 0;
+	s->refillMaxUs = 0;
+	r->tmpIRQCount = 0;
+	ResetIRQFloodDetection(r);
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+	RestoreIRQ(irqState);
+
+	StartStream(s, stereo);
+	const uint32_t startUs = TimingNow();
+	uint32_t units = 0;
+	uint32_t elapsedUs;
+	do
+	{
+		for (int i = 0; i < IRQ_CPU_WORK_NOPS; i++)
+		{
+			nop();
+		}
+		units++;
+		FillStreamBuffer(s);
+
+		// (The last IRQ has to be read first, in case one comes in between)
+		const uint32_t lastIRQUs = s->lastIRQUs;
+		const uint32_t now = TimingNow();
+		if (!r->tmpIRQFlooded && now - lastIRQUs > STREAM_STALL_US)
+		{
+			s->underruns++;
+			StartStream(s, stereo);
+		}
+		elapsedUs = now - startUs;
+	} while (elapsedUs < STREAM_RUN_US);
+
+	irqState = DisableIRQ();
+	via2WriteReg(0x1C13, 0x10);
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+	(void)ascReadReg(0x804);
+	via2WriteReg(0x1A03, 0x90);
+	RestoreIRQ(irqState);
+
+	const uint32_t rate = (uint32_t)((uint64_t)units * 1000000 / elapsedUs);
+	sr->underruns[n] = s->underruns + (r->tmpIRQFlooded ? 1 : 0);
+	sr->irqRate[n] = (uint32_t)((uint64_t)s->irqs * 1000000 / elapsedUs);
+	sr->refillAvgUs[n] = s->refills ? s->refillTotalUs / s->refills : 0;
+	sr->refillMaxUs[n] = s->refillMaxUs;
+	sr->cpuPermille[n] = CPUUsePermille(r->irqCPUBaselineRate, rate);
+}
+
+// Streams samples to the FIFOs from the IRQ handler in one mode, with each chunk size
+static void StreamInMode(TestResults *r, bool stereo)
+{
+	StreamState *s = &r->tmpStream;
+	const FIFOTestResults *f = stereo ? &r->stereoFIFO : &r->monoFIFO;
+	StreamingResults *sr = stereo ? &r->stereoStreaming : &r->monoStreaming;
+	const bool enableF29 = r->regF29Exists;
+	bool fifoA;
+
+	if (!PickIRQStatusFIFO(f, &fifoA))
+	{
+		return;
+	}
+
+	uint16_t irqState = DisableIRQ();
+	const uint8_t originalMode = ascReadReg(0x801);
+	const uint8_t originalControl = ascReadReg(0x802);
+	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
+	const uint8_t originalF09Value = r->regF09Exists ? ascReadReg(0xF09) : 0;
+	const uint8_t originalF29Value = enableF29 ? ascReadReg(0xF29) : 0;
+	VIA2Handler originalASCIRQHandler = via2Handlers()[4];
+	*(TestResults **)applScratch() = r;
+	s->fifoA = fifoA;
+	s->emptyMeansUnderrun = fifoA ? f->aReachesEmpty : f->bReachesEmpty;
+	s->rateMilliHz = 0;
+	if (fifoA ? r->drainRate.aMeasured : r->drainRate.bMeasured)
+	{
+		s->rateMilliHz = fifoA ? r->drainRate.aSampleRateMilliHz : r->drainRate.bSampleRateMilliHz;
+	}
+	via2Handlers()[4] = streamingHandlers[stereo][fifoA];
+
+	// Put in FIFO mode, and set up F09/F29 the way Test_FIFOIRQ does; the IRQ is only
+	// let through VIA2 while streaming
+	via2WriteReg(0x1C13, 0x10);
+	ascWriteReg(0x801, 1);
+	if (stereo)
+	{
+		ascWriteReg(0x802, ascReadReg(0x802) | 0x02);
+	}
+	else
+	{
+		ascWriteReg(0x802, ascReadReg(0x802) & ~0x02);
+	}
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, 1);
+	}
+	if (enableF29)
+	{
+		ascWriteReg(0xF29, 0);
+	}
+	RestoreIRQ(irqState);
+
+	// The smallest chunk that works is the one before the first that underruns
+	sr->measured = true;
+	sr->fifoA = fifoA;
+	sr->refillTimed = s->rateMilliHz != 0;
+	bool underran = false;
+	for (int n = 0; n < STREAM_CHUNK_SIZES; n++)
+	{
+		StreamWithChunk(r, s, sr, stereo, n);
+		underran = underran || sr->underruns[n];
+		if (!underran)
+		{
+			sr->minChunk = 0x200 >> n;
+		}
+	}
+
+	irqState = DisableIRQ();
+	via2Handlers()[4] = originalASCIRQHandler;
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, originalF09Value);
+	}
+	if (enableF29)
+	{
+		ascWriteReg(0xF29, originalF29Value);
+	}
+	via2WriteReg(0x1C13, irqOriginallyEnabledInVIA2 ? 0x90 : 0x10);
+	ascWriteReg(0x802, originalControl);
+	ascWriteReg(0x801, originalMode);
+	RestoreIRQ(irqState);
+}
+
+// Plays a stream for a while from the IRQ handler, which refills the FIFO from a
+// double buffered sample buffer each time it's half empty, like a sound driver does.
+// This is done in mono and stereo with smaller and smaller refill chunks, counting
+// underruns and timing the refills and the CPU they take.
+static void Test_Streaming(TestResults *r)
+{
+	if (!r->irqCPUMeasured)
+	{
+		return;
+	}
+
+	StreamState *s = &r->tmpStream;
+	memset(s, 0, sizeof(*s));
+	s->halfFree[0] = true;
+	s->halfFree[1] = true;
+	FillStreamBuffer(s);
+
+	if (r->shouldTestMono)
+	{
+		StreamInMode(r, false);
+	}
+	if (r->shouldTestStereo)
+	{
+		StreamInMode(r, true);
+	}
+}
+
+// Times one FIFO playing at whatever rate the ASC is set to, the same way Test_DrainRate
+// does: from full to half empty, then DRAIN_BLOCKS blocks of DRAIN_BLOCK_SAMPLES from half
+// empty back to half empty, and then to empty if the status shows it. Returns false if
+// the FIFO never got to one of those.
+template <bool stereo>
+static bool TimeFIFODrain(bool fifoA, bool showsEmpty, SampleRateResults *s)
+{
+	const int shift = fifoA ? 0 : 2;
+
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+	(void)ascReadReg(0x804);
+
+	// Prime it so an empty FIFO isn't mistaken for a full one, and then fill it up
+	WriteSamples<stereo>(0x100);
+	uint32_t fullUs = 0;
+	for (int i = 0; i < 0x1000 && !fullUs; i++)
+	{
+		WriteSample<stereo>(0);
+		if (((ascReadReg(0x804) >> shift) & 0x03) == 0x02)
+		{
+			fullUs = TimingNow();
+		}
+	}
+
+	uint32_t halfUs = 0;
+	if (!fullUs || !WaitForFIFOState(fifoA, !fifoA, 0x01, &halfUs, &halfUs))
+	{
+		return false;
+	}
+	s->fullToHalfUs = halfUs - fullUs;
+
+	const uint32_t firstHalfUs = halfUs;
+	for (int block = 0; block < DRAIN_BLOCKS; block++)
+	{
+		WriteSamples<stereo>(DRAIN_BLOCK_SAMPLES);
+		(void)ascReadReg(0x804);
+		if (!WaitForFIFOState(fifoA, !fifoA, 0x01, &halfUs, &halfUs))
+		{
+			return false;
+		}
+	}
+	const uint32_t blocksUs = halfUs - firstHalfUs;
+	if (!blocksUs)
+	{
+		return false;
+	}
+	s->rateMilliHz = (uint32_t)(((uint64_t)DRAIN_BLOCK_SAMPLES * DRAIN_BLOCKS * 1000000000ULL + blocksUs / 2) /
+		blocksUs);
+
+	uint32_t emptyUs = halfUs;
+	if (showsEmpty)
+	{
+		(void)WaitForFIFOState(fifoA, !fifoA, 0x03, &emptyUs, &emptyUs);
+	}
+	s->halfToEmptyUs = emptyUs - halfUs;
+	return true;
+}
+
+// Tries each setting of the clock rate register ($807), timing a FIFO with each one to
+// see how fast it actually plays. It's documented as 0 = 22257 Hz, 2 = 22050 Hz and
+// 3 = 44100 Hz; 1 is tried too, to see what it does. The FIFO timed is the one
+// Test_DrainRate timed first, in the same mode, and the register is put back afterward.
+static void Test_SampleRateSweep(TestResults *r)
+{
+	const DrainRateResults *d = &r->drainRate;
+	if (!d->aMeasured && !d->bMeasured)
+	{
+		return;
+	}
+
+	const bool stereo = r->drainRateStereo;
+	const bool fifoA = d->aMeasured;
+	const FIFOTestResults *f = stereo ? &r->stereoFIFO : &r->monoFIFO;
+	const bool showsEmpty = fifoA ? f->aReachesEmpty : f->bReachesEmpty;
+	const bool enableF29 = r->regF29Exists;
+
+	uint16_t irqState = DisableIRQ();
+	const uint8_t originalMode = ascReadReg(0x801);
+	const uint8_t originalControl = ascReadReg(0x802);
+	const uint8_t originalRate = ascReadReg(0x807);
+	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
+	const uint8_t originalF09Value = r->regF09Exists ? ascReadReg(0xF09) : 0;
+	const uint8_t originalF29Value = enableF29 ? ascReadReg(0xF29) : 0;
+
+	// Set up the way Test_DrainRate does, with the ASC IRQ off
+	ascWriteReg(0x801, 1);
+	if (stereo)
+	{
+		ascWriteReg(0x802, ascReadReg(0x802) | 0x02);
+	}
+	else
+	{
+		ascWriteReg(0x802, ascReadReg(0x802) & ~0x02);
+	}
+	via2WriteReg(0x1C13, 0x10);
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, 1);
+	}
+	if (enableF29)
+	{
+		ascWriteReg(0xF29, 1);
+	}
+
+	// Interrupts stay on, so Ticks keeps running for the timestamps
+	RestoreIRQ(irqState);
+
+	r->rateSweepTested = true;
+	r->rateSweepFIFOA = fifoA;
+	r->reg807InitialValue = originalRate;
+	for (int setting = 0; setting < RATE_SETTINGS; setting++)
+	{
+		SampleRateResults *s = &r->rateSweep[setting];
+		ascWriteReg(0x807, setting);
+		s->accepted = ascReadReg(0x807) == setting;
+		if (stereo)
+		{
+			s->measured = TimeFIFODrain<true>(fifoA, showsEmpty, s);
+		}
+		else
+		{
+			s->measured = TimeFIFODrain<false>(fifoA, showsEmpty, s);
+		}
+	}
+
+	irqState = DisableIRQ();
+	ascWriteReg(0x803, 0x80);
+	ascWriteReg(0x803, 0);
+	(void)ascReadReg(0x804);
+	ascWriteReg(0x807, originalRate);
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, originalF09Value);
+	}
+	if (enableF29)
+	{
+		ascWriteReg(0xF29, originalF29Value);
+	}
+	via2WriteReg(0x1C13, irqOriginallyEnabledInVIA2 ? 0x90 : 0x10);
+	ascWriteReg(0x802, originalControl);
+	ascWriteReg(0x801, originalMode);
+	RestoreIRQ(irqState);
+}
+
+// Writes a 32-bit ASC register a byte at a time, most significant first
+static void WriteASCRegLong(uint16_t offset, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		ascWriteReg(offset + i, (uint8_t)(value >> (24 - i * 8)));
+	}
+}
+
+// Reads a 32-bit ASC register a byte at a time, most significant first
+static uint32_t ReadASCRegLong(uint16_t offset)
+{
+	uint32_t value = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		value = (value << 8) | ascReadReg(offset + i);
+	}
+	return value;
+}
+
+// Plays a chord in wavetable mode (mode 2) to see whether it actually runs: whether the
+// phase registers move on by themselves, and what $804 and the ASC IRQ do. Then times
+// the main program's work while it plays, to compare what a second of audio costs the
+// CPU with the streaming test. The phase registers and everything else are put back
+// afterward; the wavetables are left as they are, like the FIFO contents elsewhere.
+static void Test_Wavetable(TestResults *r)
+{
+	// C major chord, in Hz
+	static const uint16_t voiceFrequencies[WAVETABLE_VOICES] = { 262, 330, 392, 523 };
+	uint8_t originalWavetableRegs[WAVETABLE_REGS_SIZE];
+
+	if (!r->acceptsMode2)
+	{
+		return;
+	}
+
+	uint16_t irqState = DisableIRQ();
+	const uint8_t originalMode = ascReadReg(0x801);
+	const bool irqOriginallyEnabledInVIA2 = via2ReadReg(0x1C13) & 0x10;
+	const uint8_t originalF09Value = r->regF09Exists ? ascReadReg(0xF09) : 0;
+	const uint8_t originalF29Value = r->regF29Exists ? ascReadReg(0xF29) : 0;
+	VIA2Handler originalASCIRQHandler = via2Handlers()[4];
+	for (int i = 0; i < WAVETABLE_REGS_SIZE; i++)
+	{
+		originalWavetableRegs[i] = ascReadReg(WAVETABLE_REGS + i);
+	}
+	*(TestResults **)applScratch() = r;
+	r->tmpIRQCount = 0;
+	ResetIRQFloodDetection(r);
+	via2Handlers()[4] = Test_IdleIRQHandler;
+	via2WriteReg(0x1C13, 0x10);
+
+	// Load a different wave into each voice (sawtooth, square, triangle, and a sawtooth
+	// an octave up), starting at phase 0, with increments for the chord at 22257 Hz
+	ascWriteReg(0x801, 2);
+	for (int i = 0; i < WAVETABLE_SAMPLES; i++)
+	{
+		const uint8_t saw = (uint8_t)(i >> 1);
+		ascWriteReg(0x000 + i, saw);
+		ascWriteReg(0x200 + i, (i < WAVETABLE_SAMPLES / 2) ? 0xC0 : 0x40);
+		ascWriteReg(0x400 + i, (i < WAVETABLE_SAMPLES / 2) ? (uint8_t)i : (uint8_t)(0x1FF - i));
+		ascWriteReg(0x600 + i, (uint8_t)(saw << 1));
+	}
+	for (int v = 0; v < WAVETABLE_VOICES; v++)
+	{
+		const uint32_t increment = (uint32_t)((uint64_t)voiceFrequencies[v] * WAVETABLE_SAMPLES * 0x8000 / 22257);
+		WriteASCRegLong(WAVETABLE_REGS + v * 8, 0);
+		WriteASCRegLong(WAVETABLE_REGS + v * 8 + 4, increment);
+	}
+	r->wavetableTested = true;
+	r->wavetable804Start = ascReadReg(0x804);
+	const uint32_t startPhase = ReadASCRegLong(WAVETABLE_REGS);
+	RestoreIRQ(irqState);
+
+	// If it's playing, voice 0 is a few hundred samples further along after two ticks
+	waitTicks(2);
+	r->wavetablePhaseAdvances = ReadASCRegLong(WAVETABLE_REGS) != startPhase;
+	r->wavetable804Later = ascReadReg(0x804);
+
+	// Let the ASC IRQ through the way Test_FIFOIRQ does, and see what it does while the
+	// main program works for a second
+	irqState = DisableIRQ();
+	(void)ascReadReg(0x804);
+	via2WriteReg(0x1A03, 0x90);
+	via2WriteReg(0x1C13, 0x90);
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, 1);
+	}
+	if (r->regF29Exists)
+	{
+		ascWriteReg(0xF29, 0);
+	}
+	const uint32_t startUs = TimingNow();
+	const uint32_t startTicks = currentTicks();
+	RestoreIRQ(irqState);
+
+	uint32_t rate = 0;
+	if (r->irqCPUMeasured)
+	{
+		rate = MainLoopRate(startUs, IRQ_CPU_STREAM_WINDOW_US);
+	}
+	else
+	{
+		WaitTicksUnlessFlooded(r, 60*1);
+	}
+	const uint32_t elapsedUs = TimingNow() - startUs;
+	const uint32_t elapsedTicks = currentTicks() - startTicks;
+
+	irqState = DisableIRQ();
+	via2Handlers()[4] = originalASCIRQHandler;
+	ascWriteReg(0x801, originalMode);
+	for (int i = 0; i < WAVETABLE_REGS_SIZE; i++)
+	{
+		ascWriteReg(WAVETABLE_REGS + i, originalWavetableRegs[i]);
+	}
+	if (r->regF09Exists)
+	{
+		ascWriteReg(0xF09, originalF09Value);
+	}
+	if (r->regF29Exists)
+	{
+		ascWriteReg(0xF29, originalF29Value);
+	}
+	(void)ascReadReg(0x804);
+	via2WriteReg(0x1A03, 0x90);
+	via2WriteReg(0x1C13, irqOriginallyEnabledInVIA2 ? 0x90 : 0x10);
+	RestoreIRQ(irqState);
+
+	r->wavetableIRQFlooded = r->tmpIRQFlooded;
+	if (r->tmpIRQFlooded)
+	{
+		r->wavetableIRQRate = r->tmpIRQFloodRate;
+	}
+	else if (r->timerSource != TimingSourceTicks)
+	{
+		r->wavetableIRQRate = elapsedUs ? (uint32_t)((uint64_t)r->tmpIRQCount * 1000000 / elapsedUs) : 0;
+	}
+	else
+	{
+		r->wavetableIRQRate = elapsedTicks ? r->tmpIRQCount * 60 / elapsedTicks : 0;
+	}
+	if (r->irqCPUMeasured)
+	{
+		r->wavetableCPUMeasured = true;
+		r->wavetableCPUPermille = CPUUsePermille(r->irqCPUBaselineRate, rate);
+	}
+}
+
+// Runs all the tests (if this machine can be tested)
+void DoTests(TestResults *r)
+{
+	memset(r, 0, sizeof(*r));
+	r->boxFlag = boxFlag();
+	r->addrMapFlags = addrMapFlags();
+	if (!CanTestMachine(r->addrMapFlags))
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < sizeof(tests)/sizeof(tests[0]); i++)
+	{
+		tests[i](r);
+	}
+	r->timerLost = (r->timerSource != TimingSourceTicks) && (TimingGetSource() == TimingSourceTicks);
+}
+
+#ifndef ASCTESTER_HOST
+static struct TestResults results;
+
+#ifdef ASCTESTER_TRACE
+static TraceBuffer trace;
+
+// Allocates the trace buffer before the tests start, so nothing is allocated while
+// recording
+static void StartTrace(void)
+{
+	if (TraceAlloc(&trace, 1UL << 20, 1000000000UL / 60))
+	{
+		traceBuffer = &trace;
+	}
+}
+
+// Stops recording and saves the trace next to the application
+static void SaveTrace(void)
+{
+	traceBuffer = NULL;
+	if (!trace.events)
+	{
+		printf("\nNot enough memory to record a trace.\n");
+		return;
+	}
+
+	FILE *f = fopen("ASCTester Trace", "wb");
+	if (f && TraceWriteFile(&trace, f))
+	{
+		printf("\nSaved %lu register accesses to \"ASCTester Trace\" (%lu didn't fit).\n",
+				(unsigned long)trace.count, (unsigned long)trace.dropped);
+	}
+	if (f)
+	{
+		fclose(f);
+	}
+	TraceFree(&trace);
+}
+#endif
+
+// If there's a sequence file next to the application, plays it instead of running
+// the tests, and prints and saves what it observed. Returns false if there isn't one.
+static bool PlaySequence(void)
+{
+	static SeqOp ops[SEQ_MAX_OPS];
+	static uint16_t observed[SEQ_MAX_OPS];
+	uint32_t count;
+
+	FILE *f = fopen("ASCTester Sequence", "r");
+	if (!f)
+	{
+		return false;
+	}
+	const bool ok = SeqReadFile(f, ops, SEQ_MAX_OPS, &count);
+	fclose(f);
+	if (!ok)
+	{
+		return true;
+	}
+
+	results.boxFlag = boxFlag();
+	results.addrMapFlags = addrMapFlags();
+	if (!CanTestMachine(results.addrMapFlags))
+	{
+		printf("This machine can't be tested.\n");
+		return true;
+	}
+	DisableASCVBLTask(&results);
+	SeqRun(ops, count, observed);
+	RestoreASCVBLTask(&results);
+
+	const uint8_t ascVersion = ascReadReg(0x800);
+	printf("ASCTester sequence, BoxFlag: %u   ASC Version: $%02X\n", results.boxFlag, ascVersion);
+	f = fopen("ASCTester Sequence Results", "w");
+	if (f)
+	{
+		fprintf(f, "ASCTester sequence, BoxFlag: %u   ASC Version: $%02X\n", results.boxFlag, ascVersion);
+	}
+	for (uint32_t i = 0; i < count; i++)
+	{
+		SeqPrintObserved(stdout, &ops[i], observed[i]);
+		if (f)
+		{
+			SeqPrintObserved(f, &ops[i], observed[i]);
+		}
+	}
+	if (f)
+	{
+		fclose(f);
+		printf("\nResults were also saved to the file \"ASCTester Sequence Results\".\n");
+	}
+	return true;
+}
+
+int main(void)
+{
+	if (PlaySequence())
+	{
+		getchar();
+		return 0;
+	}
+
+#ifdef ASCTESTER_TRACE
+	StartTrace();
+#endif
+	DoTests(&results);
+#ifdef ASCTESTER_TRACE
+	SaveTrace();
+#endif
+	PrintResults(&results);
+	printf("\n");
+	PrintMeasurements(&results);
+
+	// Save a machine-readable copy of the results next to the application
+	FILE *f = fopen("ASCTester Results", "w");
+	if (f)
+	{
+		WriteResultRecord(f, &results);
+		fclose(f);
+		printf("\nResults were also saved to the file \"ASCTester Results\".\n");
+	}
 	getchar();
 }
+#endif
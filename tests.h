@@ -0,0 +1,323 @@
+#ifndef TESTS_H
+#define TESTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <Gestalt.h>
+#include "irqevents.h"
+
+// Results for a FIFO test, kept in a different struct because we can test mono and stereo separately
+struct FIFOTestResults
+{
+	bool aFullTooSoon;						// After writing 0x100 samples to the ASC, bit 1 of reg 0x804 is already 1,
+											// which indicates it's probably not actually a playback FIFO bit
+	bool bFullTooSoon;						// After writing 0x100 samples to the ASC, bit 3 of reg 0x804 is already 1,
+											// which indicates it's probably not actually a playback FIFO bit
+	bool aReachesFull;						// When we flood the ASC with writes, bit 1 of reg 0x804 eventually becomes 1
+	bool bReachesFull;						// When we flood the ASC with writes, bit 3 of reg 0x804 eventually becomes 1
+	bool aHalfEmptyIsOffWhenFull;			// (Only if aReachesFull) Bit 0 of reg 0x804 is 0 when we first notice bit 1 is 1
+	bool bHalfEmptyIsOffWhenFull;			// (Only if bReachesFull) Bit 2 of reg 0x804 is 0 when we first notice bit 3 is 1
+	bool aHalfEmptyTurnsOn;					// (Only if aReachesFull) Bit 0 of reg 0x804 eventually becomes 1 again
+	bool bHalfEmptyTurnsOn;					// (Only if bReachesFull) Bit 2 of reg 0x804 eventually becomes 1 again
+	bool aEmptyIsOffWhenHalfEmpty;			// (Only if aHalfEmptyTurnsOn) Bit 1 of reg 0x804 is 0 when we first notice bit 0
+											// is 1 as the FIFO is draining
+	bool bEmptyIsOffWhenHalfEmpty;			// (Only if bHalfEmptyTurnsOn) Bit 3 of reg 0x804 is 0 when we first notice bit 2
+											// is 1 as the FIFO is draining
+	bool aReachesEmpty;						// (Only if aReachesFull) we eventually notice bit 1 of reg 0x804 become 1 again
+											// to indicate that FIFO A is completely empty
+	bool bReachesEmpty;						// (Only if bReachesFull) we eventually notice bit 3 of reg 0x804 become 1 again
+											// to indicate that FIFO B is completely empty
+	uint32_t aFullCount;					// Number of samples written to FIFO A before it's marked as full
+	uint32_t bFullCount;					// Number of samples written to FIFO B before it's marked as full
+};
+
+// Number of half empty IRQs the latency test times
+#define IRQ_LATENCY_SAMPLES					100
+
+// Number of buckets in the IRQ latency histogram. Bucket n counts latencies under
+// 8 << n microseconds (and not in an earlier bucket); the last one counts the rest.
+#define IRQ_LATENCY_BUCKETS					8
+
+// How fast one kind of IRQ has been coming in, for flood detection
+struct IRQFloodWindow
+{
+	uint32_t boundaryUs;					// When the current window of IRQs started
+	bool running;							// The windows since runStartUs all came in at a flood rate
+	uint32_t runStartUs;					// (Only if running) when the first of those windows started
+	uint32_t runIRQs;						// (Only if running) IRQs in those windows
+};
+
+// Results of timing a FIFO as it plays. Times come from TimingNow(), so they're only
+// measured if a VIA timer was available.
+struct DrainRateResults
+{
+	bool aMeasured;							// FIFO A was timed
+	bool bMeasured;							// FIFO B was timed
+	uint32_t aFullToHalfUs;					// (Only if aMeasured) time from noticing FIFO A is full until it's half empty
+	uint32_t bFullToHalfUs;					// (Only if bMeasured) same for FIFO B
+	uint32_t aHalfToEmptyUs;				// (Only if aMeasured) time from FIFO A being half empty until it's empty,
+											// or 0 if its status doesn't show when it's empty
+	uint32_t bHalfToEmptyUs;				// (Only if bMeasured) same for FIFO B
+	uint32_t aSampleRateMilliHz;			// (Only if aMeasured) rate FIFO A plays samples at, in thousandths of a Hz
+	uint32_t bSampleRateMilliHz;			// (Only if bMeasured) same for FIFO B
+	uint32_t aPeriodJitterUs;				// (Only if aMeasured) difference between the longest and shortest time
+											// FIFO A took to play each block of samples
+	uint32_t bPeriodJitterUs;				// (Only if bMeasured) same for FIFO B
+};
+
+// How fast samples can be written to the FIFOs in one mode, with different kinds of
+// loops. Rates are in samples per second, counting the samples for both FIFOs in stereo.
+struct FIFOWriteRateResults
+{
+	bool measured;							// The rates were measured in this mode
+	uint32_t byteRate;						// Writing a byte at a time
+	uint32_t unrolledRate;					// Writing a byte at a time, four writes per loop iteration
+	uint32_t wordRate;						// Writing a word at a time
+	uint32_t longRate;						// Writing a long word at a time
+};
+
+// Number of runs kept in the FIFO IRQ timeline
+#define IRQ_TIMELINE_RUNS					8
+
+// One run of the FIFO IRQ timeline: IRQs in a row that all saw the same FIFO status
+struct IRQTimelineRun
+{
+	uint8_t status;							// Status bits of the FIFO being tested (1 = half empty, 2 = full,
+											// 3 = empty, 0 = neither)
+	uint32_t count;							// IRQs in the run
+	uint32_t startUs;						// When the first one came, counting from when the IRQ was enabled
+	uint32_t spanUs;						// Time from the first one to the last
+};
+
+// Number of refill chunk sizes the streaming test tries. Chunk n is 0x200 >> n samples.
+#define STREAM_CHUNK_SIZES					7
+
+// Results of streaming to the FIFOs from an IRQ handler in one mode, for each chunk size
+struct StreamingResults
+{
+	bool measured;							// Streaming was tested in this mode
+	bool fifoA;								// (Only if measured) the handler went by FIFO A's status bits (otherwise B's)
+	uint32_t minChunk;						// (Only if measured) smallest chunk that streamed without underruns
+											// (0 if none did)
+	uint32_t underruns[STREAM_CHUNK_SIZES];	// Times the FIFO ran dry: the handler found it empty, or the IRQs stopped
+											// coming and the stream had to be restarted
+	uint32_t irqRate[STREAM_CHUNK_SIZES];	// IRQs per second
+	bool refillTimed;						// (Only if measured) the refills were timed (the FIFO's drain rate was known)
+	uint32_t refillAvgUs[STREAM_CHUNK_SIZES];	// (Only if refillTimed) average time from the FIFO reaching half empty
+											// until the handler had written the chunk
+	uint32_t refillMaxUs[STREAM_CHUNK_SIZES];	// (Only if refillTimed) longest of those times
+	uint32_t cpuPermille[STREAM_CHUNK_SIZES];	// Share of the CPU streaming took, in tenths of a percent
+};
+
+// Number of settings of the clock rate register ($807) the rate sweep tries
+#define RATE_SETTINGS						4
+
+// How fast a FIFO played with one setting of the clock rate register
+struct SampleRateResults
+{
+	bool accepted;							// The setting read back as written
+	bool measured;							// The FIFO was timed with this setting
+	uint32_t rateMilliHz;					// (Only if measured) measured playback rate in thousandths of a Hz
+	uint32_t fullToHalfUs;					// (Only if measured) time from the FIFO being full until it was half empty
+	uint32_t halfToEmptyUs;					// (Only if measured) time from then until it was empty (0 if the status
+											// doesn't show when it's empty)
+};
+
+// The streaming test plays from a buffer split into two halves of this many samples,
+// refilling one while the other plays
+#define STREAM_BUFFER_HALF					0x800
+
+// Bits of fraction kept when working out when the streaming FIFO next reaches half empty
+#define STREAM_TIME_FRACTION_BITS			12
+
+// A stream being played by Test_StreamingHandler. The handler copies samples out of one
+// half of the buffer and marks it free when it's done with it; the main program fills
+// free halves with new samples, the way a sound driver would.
+struct StreamState
+{
+	uint8_t buffer[2][STREAM_BUFFER_HALF];
+	volatile bool halfFree[2];				// The main program needs to fill this half
+	uint8_t half;							// Half the handler is playing from
+	uint16_t pos;							// Next sample in that half
+	uint16_t chunk;							// Samples to write each time the FIFO is half empty
+	bool fifoA;								// The handler goes by FIFO A's status bits (otherwise B's)
+	bool emptyMeansUnderrun;				// The status bits show when the FIFO is empty
+	uint32_t rateMilliHz;					// How fast that FIFO plays (0 if the refills can't be timed)
+	uint32_t chunkTime;						// Time a chunk takes to play, in microseconds with
+											// STREAM_TIME_FRACTION_BITS of fraction
+	bool halfEmptyKnown;					// When the FIFO next reaches half empty is known
+	uint32_t halfEmptyUs;					// (Only if halfEmptyKnown) when that is
+	uint32_t halfEmptyFraction;				// (Only if halfEmptyKnown) fraction of a microsecond on top of that
+	uint8_t nextSample;						// Next sample the main program puts in the buffer
+	volatile uint32_t lastIRQUs;			// When the handler last ran
+	volatile uint32_t underruns;			// Times the FIFO ran dry, or the handler got to a half the main program
+											// hadn't refilled yet
+	volatile uint32_t irqs;
+	volatile uint32_t refills;
+	volatile uint32_t refillTotalUs;
+	volatile uint32_t refillMaxUs;
+};
+
+// Test results
+struct TestResults
+{
+	uint8_t ascVersion;						// ASC revision identifier byte
+	bool isSonoraVersion;					// High nibble of ASC revision is 0xB
+	uint8_t boxFlag;						// Machine identifier byte
+	long sysVersion;						// The system version
+	uint32_t addrMapFlags;					// Value of the AddrMapFlags low-memory global
+	bool regF09Exists;						// Whether reg 0xF09 appears to exist
+	bool regF29Exists;						// Whether reg 0xF29 appears to exist
+	uint8_t regF09InitialValue;				// Value of reg 0xF09 we first observe (if it exists)
+	uint8_t regF29InitialValue;				// Value of reg 0xF29 we first observe (if it exists)
+	uint8_t reg804IdleValue;				// Value of reg 0x804 when ASC is idle
+	uint8_t reg801InitialValue;				// Value of reg 0x801 we first observe
+	bool acceptsMode0;						// Allows writing 0 to reg 0x801
+	bool acceptsMode1;						// Allows writing 1 to reg 0x801
+	bool acceptsMode2;						// Allows writing 2 to reg 0x801
+	bool acceptsConfigMono;					// Allows writing 0 to bit 1 of reg 0x802
+	bool acceptsConfigStereo;				// Allows writing 1 to bit 1 of reg 0x802
+	bool shouldTestMono;					// Whether we should actually test mono
+	bool shouldTestStereo;					// Whether we should actually test stereo
+	struct FIFOTestResults monoFIFO;		// FIFO test results in mono mode
+	struct FIFOTestResults stereoFIFO;		// FIFO test results in stereo mode
+	uint16_t via2AddressDecodeMask;			// Mask of bits that appear to be decoded inside the first 0x200 bytes of VIA2.
+											// If it's 0, it likely means it's a real VIA with a different register every
+											// 0x200 bytes in the VIA2 address space.
+	bool via2MirroringOK;					// Whether the address mirroring of the VIA2 registers works correctly
+	bool via2ReadbackConsistent;			// Whether we read back 2 identical copies of the beginning of VIA2 space during our test
+	volatile uint32_t tmpIRQCount;			// Temporary counter used during IRQ tests
+	bool idleIRQWithoutF29;					// An IRQ fires immediately when you enable IRQs without register F29 enabled
+	bool idleIRQWithF29;					// An IRQ fires immediately when you enable IRQs with register F29 enabled
+	bool refiresIdleIRQWithF29;				// An IRQ fires immediately if you disable and re-enable F29 again
+	bool floodsIRQWithoutF29;				// Floods IRQ when idle without register F29 enabled
+	bool floodsIRQWithF29;					// Floods IRQ when idle with register F29 enabled (if available)
+	bool refiresIdleIRQFloodWithF29;		// Floods IRQ when idle if you disable and re-enable F29 again
+	bool irqFloodWithoutF29TakesOverCPU;	// (Only if floodsIRQWithoutF29) the IRQ flood takes over the CPU
+	bool irqFloodWithF29TakesOverCPU;		// (Only if floodsIRQWithF29) the IRQ flood takes over the CPU
+	bool irqFloodRefireWithF29TakesOverCPU;	// (Only if refiresIdleIRQFloodWithF29) the IRQ flood takes over the CPU again
+	uint32_t idleIRQWithF29Count;			// Total count of IRQs observed at idle without F29 enabled
+	uint32_t idleIRQWithoutF29Count;		// Total count of IRQs observed at idle with F29 enabled (if available)
+	uint32_t irqCountTest;					// Temporary variable
+	struct IRQFloodWindow tmpIRQFloodWindows[4];	// Temporary: flood detection state for each IRQ count
+	volatile bool tmpIRQFlooded;			// Temporary: an IRQ flood was detected and the IRQ disabled
+	volatile uint32_t tmpIRQFloodRate;		// Temporary: IRQs per second that confirmed the flood
+	bool testedFIFOIRQs;					// True if we actually tested FIFO IRQs. False if we didn't find
+											// a working FIFO during our polling tests.
+	bool fifoIRQTestedWasA;					// True if FIFO A was tested for IRQs; false if FIFO B was tested
+	bool gotIRQOnFIFOHalfEmptyTooSoon;		// True if the half empty IRQ was too soon to be real (immediate IRQ)
+	bool gotIRQOnFIFOEmptyTooSoon;			// True if the empty IRQ was too soon to be real
+	volatile uint32_t fullIRQCount;			// Count of "FIFO full" IRQs we observed
+	volatile uint32_t halfEmptyIRQCount;	// Count of "FIFO half empty" IRQs we observed
+	volatile uint32_t emptyIRQCount;		// Count of "FIFO empty" IRQs we observed
+	volatile uint32_t otherIRQCount;		// Count of other IRQs we observed
+	uint32_t fullIRQMaxDiff;				// Maximum difference in fullIRQCount we see while waiting 4 seconds
+	uint32_t halfEmptyIRQMaxDiff;			// Maximum difference in halfEmptyIRQCount we see while waiting 4 seconds
+	uint32_t emptyIRQMaxDiff;				// Maximum difference in emptyIRQCount we see while waiting 4 seconds
+	uint32_t otherIRQMaxDiff;				// Maximum difference in otherIRQCount we see while waiting 4 seconds
+	volatile bool fifoIRQFiredAfterToggleWhenFull;	// True if an IRQ fired after we toggled the IRQ off and back on,
+													// even though FIFO was full and thus no conditions should
+													// have been met to cause an IRQ to fire at that time.
+													// If F29 exists, we use that for the toggle. Otherwise, VIA2.
+	uint8_t timerSource;					// Where timestamps come from (a TimingSource)
+	uint32_t timerResolutionNs;				// Smallest step between two timestamps
+	uint32_t timerOverheadNs;				// Time it takes to get a timestamp
+	bool timerLost;							// The OS started using the timer during the tests, so later
+											// timestamps came from Ticks
+	uint32_t cpuNopNs;						// Time one iteration of a nop() delay loop takes (0 if not calibrated)
+	uint32_t cpuASCReadNs;					// Time one ASC register read takes in a loop
+	uint32_t cpuFIFOWriteNs;				// Time one FIFO sample write takes in a loop
+	uint32_t cpuMonoFillNs;					// Time one iteration of the mono fill loop takes (write, read $804)
+	uint32_t cpuStereoFillNs;				// Time one iteration of the stereo fill loop takes (2 writes, read $804)
+	uint32_t idleIRQWithoutF29FloodRate;	// IRQs per second serviced during the idle flood without F29 (0 if it didn't
+											// flood, or it took IRQ_FLOOD_TEST_COUNT IRQs to be sure it was one)
+	uint32_t idleIRQWithF29FloodRate;		// Same, during the idle flood with F29 enabled
+	uint32_t idleIRQRefireWithF29FloodRate;	// Same, during the idle flood after toggling F29
+	uint32_t fifoIRQFloodRate;				// Same, during the FIFO IRQ test
+	uint32_t fifoIRQPollLoops;				// Loop iterations the main program made while Test_FIFOIRQ waited 4 seconds
+	bool drainRateStereo;					// The drain rate was measured in stereo mode rather than mono
+	struct DrainRateResults drainRate;		// How fast the FIFOs play
+	bool aDepthMeasured;					// FIFO A's depth was measured (in the same mode as the drain rate)
+	bool bDepthMeasured;					// FIFO B's depth was measured
+	uint32_t aDepth;						// (Only if aDepthMeasured) samples in FIFO A when it's marked as full
+	uint32_t bDepth;						// (Only if bDepthMeasured) samples in FIFO B when it's marked as full
+	uint32_t aHalfEmptyLevel;				// (Only if aDepthMeasured) samples left in FIFO A when it's marked as half empty
+	uint32_t bHalfEmptyLevel;				// (Only if bDepthMeasured) samples left in FIFO B when it's marked as half empty
+	struct FIFOWriteRateResults monoWriteRate;		// FIFO write rates in mono mode, writing FIFO A
+	struct FIFOWriteRateResults stereoWriteRate;	// FIFO write rates in stereo mode, alternating FIFO A and B
+	bool checkedWideWrites;					// We checked what happens to word and long word writes to a FIFO
+	uint8_t samplesPerWordWrite;			// (Only if checkedWideWrites) samples a word write puts in the FIFO
+	uint8_t samplesPerLongWrite;			// (Only if checkedWideWrites) samples a long word write puts in the FIFO
+	volatile uint32_t tmpIRQTimeUs;			// Temporary timestamp taken by an IRQ handler
+	uint32_t tmpIRQLatencies[IRQ_LATENCY_SAMPLES];	// Temporary: IRQ latencies measured so far
+	uint32_t irqLatencySamples;				// Half empty IRQs whose latency was measured (0 if not tested)
+	uint32_t irqLatencyMinUs;				// (Only if irqLatencySamples) shortest time from the FIFO reaching half empty
+											// until the IRQ handler ran
+	uint32_t irqLatencyMedianUs;			// (Only if irqLatencySamples) median of those times
+	uint32_t irqLatencyP99Us;				// (Only if irqLatencySamples) 99th percentile of those times
+	uint32_t irqLatencyMaxUs;				// (Only if irqLatencySamples) longest of those times
+	uint32_t irqLatencyHistogram[IRQ_LATENCY_BUCKETS];	// (Only if irqLatencySamples) how many fell in each bucket
+	struct IRQEventQueue tmpIRQEvents;		// Temporary: where an IRQ handler records what it saw
+	bool irqTimelineRecorded;				// The FIFO IRQ test was run again, recording a timeline of the IRQs
+	bool irqTimelineFlooded;				// (Only if irqTimelineRecorded) the IRQs flooded and were disabled
+	uint32_t irqTimelineIRQs;				// (Only if irqTimelineRecorded) IRQs recorded
+	uint32_t irqTimelineDropped;			// (Only if irqTimelineRecorded) IRQs that weren't recorded because the main
+											// program didn't keep up
+	uint32_t irqTimelineRunCount;			// (Only if irqTimelineRecorded) runs in irqTimeline
+	uint32_t irqTimelineMoreRuns;			// (Only if irqTimelineRecorded) runs after those that didn't fit
+	struct IRQTimelineRun irqTimeline[IRQ_TIMELINE_RUNS];	// (Only if irqTimelineRecorded) the IRQs, as runs of the
+															// same status
+	bool irqCPUMeasured;					// The CPU use of the ASC IRQ was measured
+	uint32_t irqCPUBaselineRate;			// (Only if irqCPUMeasured) units of main program work done per second with
+											// the ASC IRQ disabled
+	bool irqCPUStreamMeasured;				// (Only if irqCPUMeasured) CPU use was measured with the IRQ keeping a FIFO playing
+	uint32_t irqCPUStreamPermille;			// (Only if irqCPUStreamMeasured) share of the CPU the IRQ took, in tenths of a percent
+	uint32_t irqCPUStreamIRQRate;			// (Only if irqCPUStreamMeasured) IRQs per second
+	bool irqCPUIdleFloodMeasured;			// (Only if irqCPUMeasured) CPU use was measured in the idle flood without F29
+	uint32_t irqCPUIdleFloodPermille;		// (Only if irqCPUIdleFloodMeasured) share of the CPU the flood took
+	bool irqCPUIdleF29FloodMeasured;		// (Only if irqCPUMeasured) CPU use was measured in the idle flood with F29 enabled
+	uint32_t irqCPUIdleF29FloodPermille;	// (Only if irqCPUIdleF29FloodMeasured) share of the CPU the flood took
+	bool irqCPURefireFloodMeasured;			// (Only if irqCPUMeasured) CPU use was measured in the idle flood after toggling F29
+	uint32_t irqCPURefireFloodPermille;		// (Only if irqCPURefireFloodMeasured) share of the CPU the flood took
+	struct StreamState tmpStream;			// Temporary: state of the stream the IRQ handler is playing
+	struct StreamingResults monoStreaming;	// Streaming from an IRQ handler in mono mode
+	struct StreamingResults stereoStreaming;	// Streaming from an IRQ handler in stereo mode
+	bool rateSweepTested;					// The clock rate register was swept
+	bool rateSweepFIFOA;					// (Only if rateSweepTested) FIFO A was timed (otherwise B), in the same mode as
+											// the drain rate
+	uint8_t reg807InitialValue;				// (Only if rateSweepTested) the clock rate register before the sweep
+	struct SampleRateResults rateSweep[RATE_SETTINGS];	// (Only if rateSweepTested) results for each setting
+	bool wavetableTested;					// Wavetable mode was tried (only if acceptsMode2)
+	bool wavetablePhaseAdvances;			// (Only if wavetableTested) voice 0's phase register moved on by itself
+	uint8_t wavetable804Start;				// (Only if wavetableTested) $804 just after wavetable mode started playing
+	uint8_t wavetable804Later;				// (Only if wavetableTested) $804 a couple of ticks later
+	bool wavetableIRQFlooded;				// (Only if wavetableTested) the ASC IRQ flooded in wavetable mode
+	uint32_t wavetableIRQRate;				// (Only if wavetableTested) ASC IRQs per second in wavetable mode (the flood
+											// rate if it flooded)
+	bool wavetableCPUMeasured;				// (Only if wavetableTested) CPU use in wavetable mode was measured
+	uint32_t wavetableCPUPermille;			// (Only if wavetableCPUMeasured) share of the CPU playing in wavetable mode took,
+											// in tenths of a percent
+	bool ascVBLTaskDisabled;				// We located the Sound Manager's ASC VBL task and disabled it during the tests
+	VBLTask *ascVBLTask;					// (Only if ascVBLTaskDisabled) the task
+	ProcPtr originalASCVBLFunc;				// (Only if ascVBLTaskDisabled) its function, put back after the tests
+};
+
+// Version of the tests, printed at the top of every report
+#define TEST_VERSION						3
+
+// Version of the result record format. Readers skip keys they don't know, so adding
+// fields doesn't need a new version; only changing the meaning of an existing key does.
+#define RESULT_RECORD_VERSION				1
+
+// tests.c
+void DoTests(TestResults *r);
+
+// results.c
+bool CanTestMachine(uint32_t addrMapFlags);
+void PrintResults(const TestResults *r);
+void PrintMeasurements(const TestResults *r);
+void WriteResultRecord(FILE *f, const TestResults *r);
+bool ReadResultRecord(FILE *f, TestResults *r);
+
+#endif
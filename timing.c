@@ -0,0 +1,183 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "asctester.h"
+#include "timing.h"
+
+// VIA1 registers used here (they're $200 bytes apart)
+#define vT1C						0x0800
+#define vT2C						0x1000
+#define vCounterHigh				0x0200	// Added to a timer's low counter byte
+#define vACR						0x1600
+#define vIER						0x1C00
+
+// VIA counts in one 60 Hz tick
+#define COUNTS_PER_TICK				(TIMING_VIA_CLOCK / 60)
+
+// Microseconds = counts * US_NUMERATOR / US_DENOMINATOR (1000000 / 783360, reduced)
+#define US_NUMERATOR				15625
+#define US_DENOMINATOR				12240
+
+// Counter readings that have to change before a timer counts as running
+#define RUNNING_CHECK_READINGS		16
+
+// State of the extended timer. Only touched with IRQs disabled.
+struct TimingState
+{
+	TimingSource source;
+	uint16_t counter;						// Offset of the timer's low counter byte
+	uint8_t bit;							// The timer's bit in IER and ACR
+	uint16_t lastCount;						// Counter at the last reading
+	uint32_t lastTicks;						// Ticks at the last reading
+	uint32_t us;							// Microseconds at the last reading
+	uint32_t fraction;						// Fraction of a microsecond on top of that (out of US_DENOMINATOR)
+	uint32_t overheadNs;					// What one reading costs
+};
+
+// Each simulated machine on the host runs on its own thread with its own timer
+#ifdef ASCTESTER_HOST
+static thread_local TimingState timing;
+#else
+static TimingState timing;
+#endif
+
+// Reads the timer's counter. If the low byte wraps between reading the two halves,
+// the high byte will have changed, so try again.
+static uint16_t ReadCounter(void)
+{
+	uint8_t high, low;
+	do
+	{
+		high = via1ReadReg(timing.counter + vCounterHigh);
+		low = via1ReadReg(timing.counter);
+	} while (high != via1ReadReg(timing.counter + vCounterHigh));
+	return (high << 8) | low;
+}
+
+// A timer is free if its interrupt is off, and it's simply counting down: timer 1
+// not reloading itself (ACR bit 6), timer 2 not counting pulses (ACR bit 5). The
+// timer's bit is the same in both registers.
+static bool TimerFree(uint8_t bit)
+{
+	return !(via1ReadReg(vIER) & bit) && !(via1ReadReg(vACR) & bit);
+}
+
+// Whether the counter actually moves
+static bool CounterRunning(void)
+{
+	const uint16_t first = ReadCounter();
+	for (int i = 0; i < RUNNING_CHECK_READINGS; i++)
+	{
+		if (ReadCounter() != first)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Picks a timer and measures how long a reading takes. Call before any other test
+// uses TimingNow(); timestamps count from here.
+void TimingInit(void)
+{
+	const uint16_t irqState = DisableIRQ();
+
+	memset(&timing, 0, sizeof(timing));
+	timing.source = TimingSourceTicks;
+
+	if (TimerFree(0x40))
+	{
+		timing.source = TimingSourceVIA1Timer1;
+		timing.counter = vT1C;
+		timing.bit = 0x40;
+	}
+	else if (TimerFree(0x20))
+	{
+		timing.source = TimingSourceVIA1Timer2;
+		timing.counter = vT2C;
+		timing.bit = 0x20;
+	}
+	if (timing.source != TimingSourceTicks && !CounterRunning())
+	{
+		timing.source = TimingSourceTicks;
+	}
+
+	if (timing.source != TimingSourceTicks)
+	{
+		timing.lastCount = ReadCounter();
+	}
+	timing.lastTicks = currentTicks();
+	RestoreIRQ(irqState);
+
+	const uint32_t start = TimingNow();
+	for (int i = 0; i < TIMING_OVERHEAD_READINGS; i++)
+	{
+		(void)TimingNow();
+	}
+	timing.overheadNs = (TimingNow() - start) * 1000 / (TIMING_OVERHEAD_READINGS + 1);
+}
+
+// Microseconds since TimingInit(). Wraps around after about 71 minutes, so compare
+// timestamps by subtracting them.
+uint32_t TimingNow(void)
+{
+	const uint16_t irqState = DisableIRQ();
+	const uint32_t nowTicks = currentTicks();
+	const uint32_t elapsedTicks = nowTicks - timing.lastTicks;
+	uint32_t counts;
+
+	// If the OS has started using the timer since TimingInit(), reading it would
+	// steal its interrupts, and its reloads would throw the count off. Leave it
+	// alone from now on.
+	if (timing.source != TimingSourceTicks && !TimerFree(timing.bit))
+	{
+		timing.source = TimingSourceTicks;
+	}
+
+	if (timing.source == TimingSourceTicks)
+	{
+		counts = elapsedTicks * COUNTS_PER_TICK;
+	}
+	else
+	{
+		// The counter counts down and wraps every 65536 counts. If Ticks says more
+		// time went by than that, add the wraps that were missed; a tick either way
+		// is much less than half a wrap, so there's no doubt how many.
+		const uint16_t count = ReadCounter();
+		counts = (uint16_t)(timing.lastCount - count);
+		const uint32_t expected = elapsedTicks * COUNTS_PER_TICK;
+		if (expected > counts + 0x8000)
+		{
+			counts += (expected - counts + 0x8000) & ~0xFFFFUL;
+		}
+		timing.lastCount = count;
+	}
+	timing.lastTicks = nowTicks;
+
+	// Convert to microseconds without overflowing, keeping the leftover fraction
+	timing.us += (counts / US_DENOMINATOR) * US_NUMERATOR;
+	timing.fraction += (counts % US_DENOMINATOR) * US_NUMERATOR;
+	timing.us += timing.fraction / US_DENOMINATOR;
+	timing.fraction %= US_DENOMINATOR;
+
+	const uint32_t us = timing.us;
+	RestoreIRQ(irqState);
+	return us;
+}
+
+TimingSource TimingGetSource(void)
+{
+	return timing.source;
+}
+
+// Smallest step between two timestamps
+uint32_t TimingResolutionNs(void)
+{
+	return (timing.source == TimingSourceTicks) ? 1000000000UL / 60 : 1000000000UL / TIMING_VIA_CLOCK;
+}
+
+// Time one TimingNow() call takes, as measured by TimingInit()
+uint32_t TimingOverheadNs(void)
+{
+	return timing.overheadNs;
+}
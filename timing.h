@@ -0,0 +1,40 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Microsecond timestamps for the tests. They come from one of the VIA1 timers, whose
+// 16-bit counter runs down at the VIA clock and is extended to 32 bits here, with
+// Ticks used to count any wraparounds between readings. TimingNow() can be called
+// from IRQ handlers. Reading a timer's low counter byte clears its interrupt flag,
+// so a timer is only used if the OS doesn't have its interrupt enabled; if neither
+// one is free, the timestamps fall back to Ticks. Each reading checks again, and if
+// the OS has taken the timer in the meantime, the timestamps fall back to Ticks from
+// then on (TimingGetSource() says so).
+//
+// Ticks only advance while interrupts are enabled. The counter wraps every 65536
+// counts (about 83 ms), so if interrupts stay disabled for longer than that between
+// two readings, the wraps in between go unnoticed and the time comes out short.
+
+// VIA clock (783.36 kHz). One count is about 1.277 microseconds.
+#define TIMING_VIA_CLOCK			783360UL
+
+// Readings TimingInit() times to find out what one costs
+#define TIMING_OVERHEAD_READINGS	1000
+
+// Where the timestamps come from
+enum TimingSource
+{
+	TimingSourceTicks,						// The 60 Hz Ticks count
+	TimingSourceVIA1Timer1,					// VIA1 timer 1
+	TimingSourceVIA1Timer2					// VIA1 timer 2
+};
+
+void TimingInit(void);
+uint32_t TimingNow(void);
+TimingSource TimingGetSource(void);
+uint32_t TimingResolutionNs(void);
+uint32_t TimingOverheadNs(void);
+
+#endif
@@ -0,0 +1,99 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "trace.h"
+
+#ifdef ASCTESTER_HOST
+thread_local TraceBuffer *traceBuffer;
+#else
+#include <Memory.h>
+TraceBuffer *traceBuffer;
+#endif
+
+// Allocates room for a trace. On the Mac, the buffer is also held in physical memory
+// so IRQ handlers can record into it while virtual memory is on. Asks for less if the
+// requested capacity doesn't fit.
+bool TraceAlloc(TraceBuffer *t, uint32_t capacity, uint32_t timeUnitNs)
+{
+	t->events = NULL;
+	t->count = 0;
+	t->dropped = 0;
+	t->timeUnitNs = timeUnitNs;
+	for (; capacity >= 1024 && !t->events; capacity /= 2)
+	{
+#ifdef ASCTESTER_HOST
+		t->events = (TraceEvent *)malloc(capacity * sizeof(TraceEvent));
+#else
+		t->events = (TraceEvent *)NewPtr(capacity * sizeof(TraceEvent));
+		if (t->events)
+		{
+			HoldMemory(t->events, capacity * sizeof(TraceEvent));
+		}
+#endif
+		t->capacity = t->events ? capacity : 0;
+	}
+	return t->events != NULL;
+}
+
+// Releases a trace's buffer
+void TraceFree(TraceBuffer *t)
+{
+	if (!t->events)
+	{
+		return;
+	}
+#ifdef ASCTESTER_HOST
+	free(t->events);
+#else
+	UnholdMemory(t->events, t->capacity * sizeof(TraceEvent));
+	DisposePtr((Ptr)t->events);
+#endif
+	t->events = NULL;
+	t->capacity = 0;
+}
+
+static void Write16(FILE *f, uint16_t value)
+{
+	fputc(value >> 8, f);
+	fputc(value & 0xFF, f);
+}
+
+static void Write32(FILE *f, uint32_t value)
+{
+	Write16(f, value >> 16);
+	Write16(f, value & 0xFFFF);
+}
+
+// Writes a trace to a file. Everything is big-endian, so the file is the same no
+// matter which machine wrote it. The layout is:
+//   Header (32 bytes): "ASCTrace", format version (16 bits), reserved (16 bits), then
+//     32-bit timeUnitNs, event count, dropped event count, TRACE_INDEX_INTERVAL, and the
+//     file offset of the index
+//   Events (8 bytes each): time (32 bits), address (16 bits), value, flags
+//   Index: the time of every TRACE_INDEX_INTERVAL'th event (32 bits each), so readers
+//     can find a point in time without looking through all the events
+bool TraceWriteFile(const TraceBuffer *t, FILE *f)
+{
+	fputs("ASCTrace", f);
+	Write16(f, TRACE_FILE_VERSION);
+	Write16(f, 0);
+	Write32(f, t->timeUnitNs);
+	Write32(f, t->count);
+	Write32(f, t->dropped);
+	Write32(f, TRACE_INDEX_INTERVAL);
+	Write32(f, TRACE_HEADER_SIZE + t->count * TRACE_EVENT_SIZE);
+	for (uint32_t i = 0; i < t->count; i++)
+	{
+		const TraceEvent *e = &t->events[i];
+		Write32(f, e->time);
+		Write16(f, e->address);
+		fputc(e->value, f);
+		fputc(e->flags, f);
+	}
+	for (uint32_t i = 0; i < t->count; i += TRACE_INDEX_INTERVAL)
+	{
+		Write32(f, t->events[i].time);
+	}
+	return !ferror(f);
+}
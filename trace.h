@@ -0,0 +1,72 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Register access trace. When a trace buffer is active, every ASC and VIA2 access
+// the tests make (including from IRQ handlers) is appended to it. The buffer is
+// allocated up front, so recording never allocates; once it's full, further events
+// are only counted.
+
+// Trace file layout (see TraceWriteFile)
+#define TRACE_FILE_VERSION			2
+#define TRACE_HEADER_SIZE			32
+#define TRACE_EVENT_SIZE			8
+#define TRACE_INDEX_INTERVAL		1024
+
+// Flags of a trace event
+#define TraceWrite					0x01	// The access was a write (otherwise a read)
+#define TraceVIA2					0x02	// The address is in VIA2 (otherwise in the ASC)
+#define TraceIRQ					0x04	// The access was made from an interrupt handler
+
+// One register access
+struct TraceEvent
+{
+	uint32_t time;							// When it happened, in units of TraceBuffer::timeUnitNs
+	uint16_t address;						// Offset into the ASC or VIA2
+	uint8_t value;							// Value read or written
+	uint8_t flags;							// Trace* flags
+};
+
+// A preallocated trace
+struct TraceBuffer
+{
+	TraceEvent *events;						// Recorded events
+	uint32_t capacity;						// Number of events that fit
+	uint32_t count;							// Number of events recorded
+	uint32_t dropped;						// Events that didn't fit
+	uint32_t timeUnitNs;					// Length of one TraceEvent::time unit in nanoseconds
+};
+
+// The trace being recorded, or NULL if tracing is off. Each simulated machine
+// on the host runs on its own thread with its own trace.
+#ifdef ASCTESTER_HOST
+extern thread_local TraceBuffer *traceBuffer;
+#else
+extern TraceBuffer *traceBuffer;
+#endif
+
+// Appends an event to a trace. Callers make sure nothing else records at the same time.
+static inline void TraceStore(TraceBuffer *t, uint32_t time, uint16_t address, uint8_t value, uint8_t flags)
+{
+	if (t->count < t->capacity)
+	{
+		TraceEvent *e = &t->events[t->count++];
+		e->time = time;
+		e->address = address;
+		e->value = value;
+		e->flags = flags;
+	}
+	else
+	{
+		t->dropped++;
+	}
+}
+
+bool TraceAlloc(TraceBuffer *t, uint32_t capacity, uint32_t timeUnitNs);
+void TraceFree(TraceBuffer *t);
+bool TraceWriteFile(const TraceBuffer *t, FILE *f);
+
+#endif